@@ -0,0 +1,459 @@
+/*
+  ==============================================================================
+
+    Headless batch generator. Runs the full DungeonGenerationEngine pipeline
+    for a range of seeds on all cores and writes one file per dungeon.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/DungeonGenerationEngine.h"
+#include "../../Source/DungeonFile.h"
+#include "../../Source/WorldGenerator.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+//==============================================================================
+static void printUsage()
+{
+    std::cout
+        << "Usage:" << std::endl
+        << "  DungeonGenBatch --params=<file.xml> --seeds=<first>:<last> --out=<dir> [--threads=<n>] [--chunk-size=<n>] [--format=json|binary] [--stats] [--quiet]" << std::endl
+        << "  DungeonGenBatch --params=<file.xml> --world=<x0>:<y0>:<x1>:<y1> --out=<dir> [--world-chunk=<n>] [--portals=<n>] [--seeds=<seed>] [--threads=<n>] [--quiet]" << std::endl
+        << "  DungeonGenBatch --write-params=<file.xml>" << std::endl
+        << std::endl
+        << "The parameter file uses the same layout as the editor state; missing" << std::endl
+        << "properties fall back to the editor defaults. Use --write-params to get" << std::endl
+        << "a template." << std::endl
+        << std::endl
+        << "With --chunk-size the tile map is rasterised and written one chunk at a" << std::endl
+        << "time as \"tileChunks\" instead of a single \"tiles\" array." << std::endl
+        << std::endl
+        << "--format=binary writes every dungeon into one memory-mappable" << std::endl
+        << "dungeons.bin (see Source/DungeonFile.h) instead of one JSON file each." << std::endl
+        << std::endl
+        << "--stats records per-stage timings and counters; they are added to each" << std::endl
+        << "JSON file as \"stats\", or collected in stats.json for binary output." << std::endl
+        << std::endl
+        << "--world generates chunks [x0, x1) x [y0, y1) of an unbounded world (see" << std::endl
+        << "Source/WorldGenerator.h), world-chunk tiles square (default 64) with" << std::endl
+        << "portals per edge (default 1), into chunk_<x>_<y>.json. The world seed" << std::endl
+        << "is the first of --seeds, or the parameter file's seed. Every portal" << std::endl
+        << "opening is checked to be open on the chunk's border." << std::endl;
+}
+
+static juce::var boxesToVar(const DungeonGenerationEngine::RoomBoxVec& boxes)
+{
+    juce::Array<juce::var> arr;
+    for (const auto& box : boxes)
+        arr.add(juce::Array<juce::var>{ box.x, box.y, box.w, box.h });
+    return arr;
+}
+
+static juce::var tilesToVar(const DungeonGenerationEngine::TileGrid& tiles)
+{
+    juce::Array<juce::var> rows;
+    for (int y = 0; y < tiles.getHeight(); y++)
+    {
+        juce::String row;
+        row.preallocateBytes((size_t)tiles.getWidth());
+        for (int x = 0; x < tiles.getWidth(); x++)
+            row << tiles.get(x, y);
+        rows.add(row);
+    }
+    return rows;
+}
+
+static juce::var dungeonToVar(const DungeonGenerationEngine::Parameters& params, const DungeonGenerationEngine::Dungeon& dungeon)
+{
+    auto* obj = new juce::DynamicObject();
+    obj->setProperty("seed", (juce::int64)params.seed);
+    obj->setProperty("mapWidth", (int)params.mapWidth);
+    obj->setProperty("mapHeight", (int)params.mapHeight);
+    obj->setProperty("rooms", boxesToVar(dungeon.rooms));
+    obj->setProperty("corridors", boxesToVar(dungeon.corridors));
+
+    juce::Array<juce::var> edges;
+    for (const auto& e : dungeon.mst_edges)
+        edges.add(juce::Array<juce::var>{ e.first, e.second });
+    obj->setProperty("edges", edges);
+
+    juce::Array<juce::var> lines;
+    for (const auto& line : dungeon.lines)
+        lines.add(juce::Array<juce::var>{ std::get<0>(line), std::get<1>(line), std::get<2>(line), std::get<3>(line) });
+    obj->setProperty("lines", lines);
+
+    if (!dungeon.tiles.empty())
+        obj->setProperty("tiles", tilesToVar(dungeon.tiles));
+
+    return juce::var(obj);
+}
+
+// Writes the dungeon with its tile map rasterised chunk by chunk, so only one
+// chunk of tiles is held in memory at a time.
+static bool writeChunked(DungeonGenerationEngine& engine, const juce::File& file, int chunkSize,
+    const DungeonGenerationEngine::Parameters& params, const DungeonGenerationEngine::Dungeon& dungeon,
+    const DungeonGenerationEngine::Stats* stats)
+{
+    file.deleteFile();
+    juce::FileOutputStream out(file);
+    if (out.failedToOpen())
+        return false;
+
+    auto head = juce::JSON::toString(dungeonToVar(params, dungeon), true);
+    out << head.dropLastCharacters(1) << ", \"tileChunks\": [";
+    bool first = true;
+    engine.forEachChunk(dungeon.rooms, dungeon.corridors, dungeon.lines, params.mapWidth, params.mapHeight, chunkSize,
+        [&](int x, int y, const DungeonGenerationEngine::TileGrid& chunk)
+        {
+            auto* obj = new juce::DynamicObject();
+            obj->setProperty("x", x);
+            obj->setProperty("y", y);
+            obj->setProperty("tiles", tilesToVar(chunk));
+            out << (first ? "" : ", ") << juce::JSON::toString(juce::var(obj), true);
+            first = false;
+        });
+    out << "]";
+    if (stats != nullptr)
+        out << ", \"stats\": " << juce::JSON::toString(stats->toVar(), true);
+    out << "}";
+    out.flush();
+    return out.getStatus().wasOk();
+}
+
+//==============================================================================
+// Portal openings of a chunk without floor on its border tiles. Both chunks of
+// an edge compute the same portals, so a seam is joined when neither side
+// reports one.
+static int countClosedPortals(const WorldGenerator::Chunk& chunk, int chunkSize)
+{
+    using Side = WorldGenerator::Side;
+    const auto& tiles = chunk.dungeon.tiles;
+    int closed = 0;
+    for (int s = 0; s < 4; s++)
+    {
+        const auto side = (Side)s;
+        for (int portal : chunk.portals[s])
+        {
+            for (int t : { portal, portal + 1 })
+            {
+                int x = side == Side::west ? 0 : side == Side::east ? chunkSize - 1 : t;
+                int y = side == Side::north ? 0 : side == Side::south ? chunkSize - 1 : t;
+                if (tiles.empty() || tiles.get(x, y) == 0)
+                {
+                    closed++;
+                    break;
+                }
+            }
+        }
+    }
+    return closed;
+}
+
+static int runWorld(const juce::ArgumentList& args, DungeonGenerationEngine::Parameters params,
+    const juce::File& outDir, int numThreads, bool quiet)
+{
+    auto range = juce::StringArray::fromTokens(args.getValueForOption("--world"), ":", "");
+    const int chunkSize = args.containsOption("--world-chunk") ? args.getValueForOption("--world-chunk").getIntValue() : 64;
+    const int portals = args.containsOption("--portals") ? args.getValueForOption("--portals").getIntValue() : 1;
+    if (range.size() != 4 || chunkSize < 4 || portals < 0)
+    {
+        printUsage();
+        return 1;
+    }
+    if (args.containsOption("--seeds"))
+        params.seed = (unsigned int)args.getValueForOption("--seeds").upToFirstOccurrenceOf(":", false, false).getLargeIntValue();
+
+    const int x0 = range[0].getIntValue(), y0 = range[1].getIntValue();
+    const int x1 = range[2].getIntValue(), y1 = range[3].getIntValue();
+    WorldGenerator world(params, chunkSize, portals);
+
+    using Clock = std::chrono::steady_clock;
+    std::atomic<int> numFailed{ 0 };
+    std::atomic<int> numClosed{ 0 };
+    std::atomic<int> numPortals{ 0 };
+    std::mutex printLock;
+
+    auto writeChunk = [&](const WorldGenerator::Chunk& chunk)
+    {
+        const auto name = juce::String(chunk.chunkX) + ", " + juce::String(chunk.chunkY);
+        if (!chunk.error.empty())
+        {
+            numFailed++;
+            std::lock_guard<std::mutex> lock(printLock);
+            std::cerr << "chunk " << name << ": failed (" << chunk.error << ")" << std::endl;
+            return;
+        }
+
+        for (const auto& side : chunk.portals)
+            numPortals += (int)side.size();
+        int closed = countClosedPortals(chunk, chunkSize);
+        numClosed += closed;
+
+        auto p = world.getParameters();
+        p.seed = WorldGenerator::getChunkSeed(params.seed, chunk.chunkX, chunk.chunkY);
+        auto json = dungeonToVar(p, chunk.dungeon);
+        auto* obj = json.getDynamicObject();
+        obj->setProperty("chunkX", chunk.chunkX);
+        obj->setProperty("chunkY", chunk.chunkY);
+        auto* portalObj = new juce::DynamicObject();
+        const char* sideNames[] = { "north", "south", "west", "east" };
+        for (int s = 0; s < 4; s++)
+        {
+            juce::Array<juce::var> list;
+            for (int portal : chunk.portals[s])
+                list.add(portal);
+            portalObj->setProperty(sideNames[s], list);
+        }
+        obj->setProperty("portals", juce::var(portalObj));
+
+        auto file = outDir.getChildFile("chunk_" + juce::String(chunk.chunkX) + "_" + juce::String(chunk.chunkY) + ".json");
+        if (!file.replaceWithText(juce::JSON::toString(json, true)))
+            throw std::runtime_error("cannot write " + file.getFullPathName().toStdString());
+
+        if (!quiet || closed > 0)
+        {
+            std::lock_guard<std::mutex> lock(printLock);
+            std::cout << "chunk " << name << ": " << chunk.dungeon.rooms.size() << " rooms";
+            if (closed > 0)
+                std::cout << ", " << closed << " closed portals";
+            std::cout << std::endl;
+        }
+    };
+
+    auto start = Clock::now();
+    try
+    {
+        world.generateRegion(x0, y0, x1, y1, numThreads, writeChunk);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "World generation stopped: " << e.what() << std::endl;
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    const int total = std::max(0, x1 - x0) * std::max(0, y1 - y0);
+    std::cout << "Generated " << (total - numFailed) << " of " << total << " chunks on "
+        << numThreads << " threads in " << seconds << " s; "
+        << (numPortals - numClosed) << " of " << numPortals << " portal openings open" << std::endl;
+
+    return numFailed > 0 || numClosed > 0 ? 1 : 0;
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    juce::ArgumentList args(argc, argv);
+
+    if (args.containsOption("--help|-h"))
+    {
+        printUsage();
+        return 0;
+    }
+
+    if (args.containsOption("--write-params"))
+    {
+        auto file = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--write-params"));
+        auto xml = DungeonGenerationEngine::Parameters().toValueTree().createXml();
+        if (xml == nullptr || !xml->writeTo(file))
+        {
+            std::cerr << "Cannot write " << file.getFullPathName() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    auto paramsPath = args.getValueForOption("--params");
+    auto seedRange = args.getValueForOption("--seeds");
+    auto outPath = args.getValueForOption("--out");
+    const bool worldMode = args.containsOption("--world");
+    if (paramsPath.isEmpty() || (seedRange.isEmpty() && !worldMode) || outPath.isEmpty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    juce::File paramsFile = juce::File::getCurrentWorkingDirectory().getChildFile(paramsPath);
+    auto xml = juce::parseXML(paramsFile);
+    if (xml == nullptr)
+    {
+        std::cerr << "Cannot parse " << paramsFile.getFullPathName() << std::endl;
+        return 1;
+    }
+    const auto params = DungeonGenerationEngine::Parameters::fromValueTree(juce::ValueTree::fromXml(*xml));
+
+    juce::int64 firstSeed = seedRange.upToFirstOccurrenceOf(":", false, false).getLargeIntValue();
+    juce::int64 lastSeed = seedRange.contains(":") ? seedRange.fromFirstOccurrenceOf(":", false, false).getLargeIntValue() : firstSeed;
+    if (lastSeed < firstSeed)
+    {
+        std::cerr << "Empty seed range " << seedRange << std::endl;
+        return 1;
+    }
+
+    juce::File outDir = juce::File::getCurrentWorkingDirectory().getChildFile(outPath);
+    if (!outDir.createDirectory())
+    {
+        std::cerr << "Cannot create " << outDir.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    int numThreads = args.containsOption("--threads")
+        ? args.getValueForOption("--threads").getIntValue()
+        : (int)std::thread::hardware_concurrency();
+    numThreads = std::max(1, numThreads);
+    const bool quiet = args.containsOption("--quiet");
+    if (worldMode)
+        return runWorld(args, params, outDir, numThreads, quiet);
+
+    const bool recordStats = args.containsOption("--stats");
+    const int chunkSize = args.containsOption("--chunk-size") ? args.getValueForOption("--chunk-size").getIntValue() : 0;
+    if (args.containsOption("--chunk-size") && chunkSize <= 0)
+    {
+        std::cerr << "Invalid chunk size " << args.getValueForOption("--chunk-size") << std::endl;
+        return 1;
+    }
+
+    const auto format = args.containsOption("--format") ? args.getValueForOption("--format") : juce::String("json");
+    if (format != "json" && format != "binary")
+    {
+        std::cerr << "Unknown format " << format << std::endl;
+        return 1;
+    }
+    if (format == "binary" && chunkSize > 0)
+    {
+        std::cerr << "--chunk-size only applies to JSON output" << std::endl;
+        return 1;
+    }
+
+    // Dungeons are appended in completion order; each record carries its seed.
+    std::unique_ptr<DungeonFile::Writer> binaryWriter;
+    std::mutex binaryLock;
+    juce::Array<juce::var> binaryStats;
+    if (format == "binary")
+    {
+        binaryWriter = std::make_unique<DungeonFile::Writer>(outDir.getChildFile("dungeons.bin"));
+        if (!binaryWriter->openedOk())
+        {
+            std::cerr << "Cannot write " << outDir.getChildFile("dungeons.bin").getFullPathName() << std::endl;
+            return 1;
+        }
+    }
+
+    using Clock = std::chrono::steady_clock;
+
+    std::atomic<juce::int64> nextSeed{ firstSeed };
+    std::atomic<int> numFailed{ 0 };
+    std::mutex printLock;
+
+    auto worker = [&]()
+    {
+        // One seed per thread already keeps every core busy.
+        DungeonGenerationEngine engine;
+        engine.numThreads = 1;
+        // Scratch and dungeon storage are reused from one seed to the next.
+        DungeonGenerationEngine::GenerationWorkspace workspace;
+        engine.workspace = &workspace;
+        DungeonGenerationEngine::Dungeon dungeon;
+        DungeonGenerationEngine::Stats stats;
+        if (recordStats)
+            engine.stats = &stats;
+        for (;;)
+        {
+            juce::int64 seed = nextSeed++;
+            if (seed > lastSeed)
+                break;
+
+            auto p = params;
+            p.seed = (unsigned int)seed;
+            try
+            {
+                auto file = outDir.getChildFile("dungeon_" + juce::String(seed) + ".json");
+                auto start = Clock::now();
+                double ms;
+                if (chunkSize > 0)
+                {
+                    // Everything but the tiling step; writeChunked rasterises as it writes.
+                    engine.generate(p, dungeon, DungeonGenerationEngine::numSteps - 2);
+                    if (!writeChunked(engine, file, chunkSize, p, dungeon, engine.stats))
+                        throw std::runtime_error("cannot write " + file.getFullPathName().toStdString());
+                    ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                }
+                else
+                {
+                    engine.generate(p, dungeon);
+                    ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                    if (binaryWriter != nullptr)
+                    {
+                        std::lock_guard<std::mutex> lock(binaryLock);
+                        if (!binaryWriter->add((std::uint64_t)seed, dungeon))
+                            throw std::runtime_error("cannot append to dungeons.bin");
+                        if (recordStats)
+                        {
+                            auto* entry = new juce::DynamicObject();
+                            entry->setProperty("seed", seed);
+                            entry->setProperty("stats", stats.toVar());
+                            binaryStats.add(juce::var(entry));
+                        }
+                    }
+                    else
+                    {
+                        auto json = dungeonToVar(p, dungeon);
+                        if (recordStats)
+                            json.getDynamicObject()->setProperty("stats", stats.toVar());
+                        if (!file.replaceWithText(juce::JSON::toString(json, true)))
+                            throw std::runtime_error("cannot write " + file.getFullPathName().toStdString());
+                    }
+                }
+
+                if (!quiet)
+                {
+                    std::lock_guard<std::mutex> lock(printLock);
+                    std::cout << "seed " << seed << ": " << ms << " ms, "
+                        << (ms > 0.0 ? 1000.0 / ms : 0.0) << " dungeons/s" << std::endl;
+                }
+            }
+            catch (const std::exception& e)
+            {
+                numFailed++;
+                std::lock_guard<std::mutex> lock(printLock);
+                std::cerr << "seed " << seed << ": failed (" << e.what() << ")" << std::endl;
+            }
+        }
+    };
+
+    auto start = Clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < numThreads; i++)
+        workers.emplace_back(worker);
+    for (auto& t : workers)
+        t.join();
+    if (binaryWriter != nullptr && !binaryWriter->finish())
+    {
+        std::cerr << "Cannot finish dungeons.bin" << std::endl;
+        return 1;
+    }
+    if (binaryWriter != nullptr && recordStats)
+    {
+        auto statsFile = outDir.getChildFile("stats.json");
+        if (!statsFile.replaceWithText(juce::JSON::toString(binaryStats)))
+        {
+            std::cerr << "Cannot write " << statsFile.getFullPathName() << std::endl;
+            return 1;
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    juce::int64 total = lastSeed - firstSeed + 1;
+    std::cout << "Generated " << (total - numFailed) << " of " << total << " dungeons on "
+        << numThreads << " threads in " << seconds << " s, "
+        << (seconds > 0.0 ? (total - numFailed) / seconds : 0.0) << " dungeons/s" << std::endl;
+
+    return numFailed > 0 ? 1 : 0;
+}
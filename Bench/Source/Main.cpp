@@ -0,0 +1,412 @@
+/*
+  ==============================================================================
+
+    Per-stage micro-benchmarks for DungeonGenerationEngine. Each stage is timed
+    on its own, with inputs prepared by the earlier stages outside the timed
+    region, across a grid of box counts, map sizes and box distributions.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/DungeonGenerationEngine.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+//==============================================================================
+// Every heap allocation in the process goes through these, so the number of
+// allocations made by a stage is the counter difference across its call.
+
+static std::atomic<long long> numAllocations{ 0 };
+
+void* operator new(std::size_t size)
+{
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+//==============================================================================
+struct BenchConfig
+{
+    unsigned int numBox;
+    unsigned int mapSize;
+    bool normalDist;
+};
+
+static DungeonGenerationEngine::Parameters makeParameters(const BenchConfig& config, unsigned int seed)
+{
+    DungeonGenerationEngine::Parameters p;
+    p.seed = seed;
+    p.numBox = config.numBox;
+    // maxIteration caps the boxes kept; the 1M configuration needs it raised.
+    p.maxIteration = std::max(p.maxIteration, config.numBox);
+    p.mapWidth = config.mapSize;
+    p.mapHeight = config.mapSize;
+    // Scatter radius grows with the box count so density stays comparable.
+    p.radiusX = p.radiusY = std::max(8.0f, std::sqrt((float)config.numBox));
+    p.numRooms = std::max(12u, config.numBox / 8);
+    p.smallBoxUseNormalDist = config.normalDist;
+    p.largeBoxUseNormalDist = config.normalDist;
+    return p;
+}
+
+// Items a stage works on, for throughput: boxes up to randSelect, rooms for the
+// graph stages, tiles for tiling.
+template <typename Dungeon>
+static double stageItems(int stage, const DungeonGenerationEngine::Parameters& p, const Dungeon& input)
+{
+    if (stage == 0)
+        return p.numBox;
+    if (stage <= 3)
+        return (double)input.boxes.size();
+    if (stage <= 7)
+        return (double)input.rooms.size();
+    if (stage == 8)
+        return (double)input.boxes.size();
+    return (double)p.mapWidth * p.mapHeight;
+}
+
+struct StageResult
+{
+    double nsPerOp = 0.0;
+    double allocsPerOp = 0.0;
+    double itemsPerSecond = 0.0;
+    double maxSeconds = 0.0;
+    int ops = 0;
+};
+
+struct BenchOptions
+{
+    juce::String onlyStage;
+    unsigned int numSeeds;
+    double minSeconds;
+    double budgetSeconds;
+    bool csv;
+    bool useWorkspace;
+};
+
+//==============================================================================
+static void printUsage()
+{
+    std::cout
+        << "Usage:" << std::endl
+        << "  DungeonGenBench [--stage=<name>] [--max-boxes=<n>] [--max-map=<n>] [--seeds=<n>]" << std::endl
+        << "                  [--min-time=<ms>] [--budget=<s>] [--workspace] [--coord=<type>] [--csv]" << std::endl
+        << std::endl
+        << "Times every stage in isolation for numBox 100..1M, map sizes 64..8192 and" << std::endl
+        << "uniform/normal box sizes, using seeds 0..n-1 (default 3). Each case repeats" << std::endl
+        << "until min-time (default 200 ms) has been spent in the stage. Once a single" << std::endl
+        << "call of a stage exceeds the budget (default 10 s), larger box counts are" << std::endl
+        << "skipped for that stage. --workspace gives the engine a GenerationWorkspace," << std::endl
+        << "so allocs/op shows the steady state once its buffers have grown. --coord" << std::endl
+        << "picks the box coordinate type: double (default), float or fixed." << std::endl
+        << std::endl
+        << "  DungeonGenBench --verify" << std::endl
+        << std::endl
+        << "Generates the golden seeds with every coordinate type and compares each" << std::endl
+        << "dungeon against the hash recorded on the reference build; exits with 1 if" << std::endl
+        << "any differs." << std::endl;
+}
+
+//==============================================================================
+// Golden seeds. The same parameters must give the same dungeon on every
+// platform and thread count, so these hashes are fixed: a mismatch means the
+// arithmetic changed, e.g. a compiler fusing a*b+c into one FMA (the exporters
+// build with -ffp-contract=off for this reason).
+
+struct GoldenCase
+{
+    const char* coord;
+    unsigned int seed;
+    bool normalDist;
+    bool parallelSeparation;
+    std::uint64_t hash;
+};
+
+static const GoldenCase goldenCases[] = {
+    { "double", 0, false, false, 0x800924dd24e97db0ull },
+    { "double", 1, true, false, 0xb1edaa2fe3de4560ull },
+    { "double", 2, false, true, 0x665620ba77848536ull },
+    { "double", 3, true, true, 0x93563d463203165eull },
+    { "float", 0, false, false, 0xd69863e77c2f3067ull },
+    { "float", 1, true, false, 0xb39afefec28f5e2aull },
+    { "float", 2, false, true, 0x45c61bf42b9c47c1ull },
+    { "float", 3, true, true, 0x915816112c324b96ull },
+    { "fixed", 0, false, false, 0x0c0eb8cdca24ab51ull },
+    { "fixed", 1, true, false, 0xebec012a0280b059ull },
+    { "fixed", 2, false, true, 0xd476ebb09e6a5909ull },
+    { "fixed", 3, true, true, 0xd5451f81918b0b10ull },
+};
+
+struct DungeonHash
+{
+    // FNV-1a over the bytes of every value added.
+    std::uint64_t value = 0xcbf29ce484222325ull;
+
+    void addBytes(const void* data, size_t size)
+    {
+        auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
+            value = (value ^ bytes[i]) * 0x100000001b3ull;
+    }
+    void add(double v) { addBytes(&v, sizeof(v)); }
+    void add(std::int64_t v) { addBytes(&v, sizeof(v)); }
+
+    template <typename RoomBoxVec>
+    void addBoxes(const RoomBoxVec& boxes)
+    {
+        add((std::int64_t)boxes.size());
+        for (const auto& box : boxes)
+        {
+            add((double)box.cx);
+            add((double)box.cy);
+            add((double)box.w);
+            add((double)box.h);
+        }
+    }
+
+    template <typename Dungeon>
+    void addDungeon(const Dungeon& d)
+    {
+        addBoxes(d.boxes);
+        addBoxes(d.rooms);
+        addBoxes(d.corridors);
+        add((std::int64_t)d.mst_edges.size());
+        for (const auto& edge : d.mst_edges)
+        {
+            add((std::int64_t)edge.first);
+            add((std::int64_t)edge.second);
+        }
+        add((std::int64_t)d.lines.size());
+        for (const auto& line : d.lines)
+        {
+            add(std::get<0>(line));
+            add(std::get<1>(line));
+            add(std::get<2>(line));
+            add(std::get<3>(line));
+        }
+        for (int tile : d.tiles.toVector())
+            add((std::int64_t)tile);
+    }
+};
+
+template <typename Engine>
+static std::uint64_t hashGoldenCase(const GoldenCase& golden)
+{
+    auto p = makeParameters({ 1000, 128, golden.normalDist }, golden.seed);
+    p.parallelSeparation = golden.parallelSeparation;
+    Engine engine;
+    engine.numThreads = 4;
+    DungeonHash hash;
+    hash.addDungeon(engine.generate(p));
+    return hash.value;
+}
+
+static int verifyGoldenSeeds()
+{
+    int failures = 0;
+    for (const auto& golden : goldenCases)
+    {
+        std::uint64_t hash = 0;
+        if (std::strcmp(golden.coord, "double") == 0)
+            hash = hashGoldenCase<DungeonGenerationEngine>(golden);
+        else if (std::strcmp(golden.coord, "float") == 0)
+            hash = hashGoldenCase<FloatDungeonGenerationEngine>(golden);
+        else if (std::strcmp(golden.coord, "fixed") == 0)
+            hash = hashGoldenCase<FixedDungeonGenerationEngine>(golden);
+
+        const bool ok = hash == golden.hash;
+        failures += ok ? 0 : 1;
+        std::printf("%-6s seed %u %-7s %-8s %016llx %s\n", golden.coord, golden.seed,
+            golden.normalDist ? "normal" : "uniform", golden.parallelSeparation ? "parallel" : "serial",
+            (unsigned long long)hash, ok ? "ok" : "MISMATCH");
+    }
+    std::printf("%d of %d golden seeds match\n", (int)(sizeof(goldenCases) / sizeof(goldenCases[0])) - failures,
+        (int)(sizeof(goldenCases) / sizeof(goldenCases[0])));
+    return failures > 0 ? 1 : 0;
+}
+
+template <typename Engine>
+static void runBenchmarks(const std::vector<BenchConfig>& grid, const BenchOptions& options)
+{
+    const auto& onlyStage = options.onlyStage;
+    const unsigned int numSeeds = options.numSeeds;
+    const double minSeconds = options.minSeconds;
+    const double budgetSeconds = options.budgetSeconds;
+    const bool csv = options.csv;
+
+    using Clock = std::chrono::steady_clock;
+
+    if (csv)
+        std::printf("stage,numBox,map,dist,ns_per_op,allocs_per_op,items_per_s,ops\n");
+    else
+        std::printf("%-18s %8s %6s %-7s %14s %12s %14s %6s\n",
+            "stage", "numBox", "map", "dist", "ns/op", "allocs/op", "items/s", "ops");
+
+    double slowest[DungeonGenerationEngine::numSteps] = {};
+    Engine engine;
+    typename Engine::GenerationWorkspace workspace;
+    if (options.useWorkspace)
+        engine.workspace = &workspace;
+
+    for (const auto& config : grid)
+    {
+        StageResult results[DungeonGenerationEngine::numSteps];
+        long long totalNs[DungeonGenerationEngine::numSteps] = {};
+        long long totalAllocs[DungeonGenerationEngine::numSteps] = {};
+        double totalItems[DungeonGenerationEngine::numSteps] = {};
+
+        bool wanted[DungeonGenerationEngine::numSteps];
+        for (int s = 0; s < DungeonGenerationEngine::numSteps; s++)
+            wanted[s] = (onlyStage.isEmpty() || onlyStage == DungeonGenerationEngine::stageNames[s]) && slowest[s] <= budgetSeconds;
+
+        // Later stages need the earlier ones' output, so the pipeline always runs
+        // up to the last stage being measured.
+        int lastWanted = -1;
+        for (int s = 0; s < DungeonGenerationEngine::numSteps; s++)
+            if (wanted[s])
+                lastWanted = s;
+        if (lastWanted < 0)
+            continue;
+
+        for (unsigned int seed = 0; seed < numSeeds; seed++)
+        {
+            const auto p = makeParameters(config, seed);
+            typename Engine::Dungeon d;
+            for (int s = 0; s <= lastWanted; s++)
+            {
+                if (!wanted[s])
+                {
+                    engine.runStep(s, p, d);
+                    continue;
+                }
+
+                auto& result = results[s];
+                typename Engine::Dungeon output;
+                double spent = 0.0;
+                int runs = 0;
+                do
+                {
+                    if (engine.workspace != nullptr)
+                        workspace.recycle(std::move(output));
+                    output = d;
+                    long long allocsBefore = numAllocations.load();
+                    auto start = Clock::now();
+                    engine.runStep(s, p, output);
+                    auto elapsed = Clock::now() - start;
+                    totalAllocs[s] += numAllocations.load() - allocsBefore;
+
+                    double seconds = std::chrono::duration<double>(elapsed).count();
+                    totalNs[s] += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+                    totalItems[s] += stageItems(s, p, d);
+                    result.maxSeconds = std::max(result.maxSeconds, seconds);
+                    spent += seconds;
+                    runs++;
+                } while (spent * numSeeds < minSeconds);
+                result.ops += runs;
+                d = std::move(output);
+            }
+        }
+
+        for (int s = 0; s < DungeonGenerationEngine::numSteps; s++)
+        {
+            auto& result = results[s];
+            if (result.ops == 0)
+                continue;
+            result.nsPerOp = (double)totalNs[s] / result.ops;
+            result.allocsPerOp = (double)totalAllocs[s] / result.ops;
+            result.itemsPerSecond = totalNs[s] > 0 ? totalItems[s] * 1e9 / (double)totalNs[s] : 0.0;
+            slowest[s] = std::max(slowest[s], result.maxSeconds);
+
+            const char* dist = config.normalDist ? "normal" : "uniform";
+            if (csv)
+                std::printf("%s,%u,%u,%s,%.0f,%.1f,%.0f,%d\n", DungeonGenerationEngine::stageNames[s], config.numBox, config.mapSize, dist,
+                    result.nsPerOp, result.allocsPerOp, result.itemsPerSecond, result.ops);
+            else
+                std::printf("%-18s %8u %6u %-7s %14.0f %12.1f %14.0f %6d\n", DungeonGenerationEngine::stageNames[s], config.numBox, config.mapSize, dist,
+                    result.nsPerOp, result.allocsPerOp, result.itemsPerSecond, result.ops);
+        }
+        std::fflush(stdout);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ArgumentList args(argc, argv);
+    if (args.containsOption("--help|-h"))
+    {
+        printUsage();
+        return 0;
+    }
+    if (args.containsOption("--verify"))
+        return verifyGoldenSeeds();
+
+    auto intOption = [&args](const char* name, int fallback)
+    {
+        return args.containsOption(name) ? args.getValueForOption(name).getIntValue() : fallback;
+    };
+    const unsigned int maxBoxes = (unsigned int)intOption("--max-boxes", 1000000);
+    const unsigned int maxMap = (unsigned int)intOption("--max-map", 8192);
+
+    BenchOptions options;
+    options.onlyStage = args.getValueForOption("--stage");
+    options.numSeeds = (unsigned int)std::max(1, intOption("--seeds", 3));
+    options.minSeconds = intOption("--min-time", 200) / 1000.0;
+    options.budgetSeconds = intOption("--budget", 10);
+    options.csv = args.containsOption("--csv");
+    options.useWorkspace = args.containsOption("--workspace");
+
+    std::vector<BenchConfig> grid;
+    for (unsigned int numBox : { 100u, 1000u, 10000u, 100000u, 1000000u })
+        for (unsigned int mapSize : { 64u, 512u, 8192u })
+            for (bool normalDist : { false, true })
+                if (numBox <= maxBoxes && mapSize <= maxMap)
+                    grid.push_back({ numBox, mapSize, normalDist });
+
+    const auto coord = args.containsOption("--coord") ? args.getValueForOption("--coord") : juce::String("double");
+    if (coord == "double")
+        runBenchmarks<DungeonGenerationEngine>(grid, options);
+    else if (coord == "float")
+        runBenchmarks<FloatDungeonGenerationEngine>(grid, options);
+    else if (coord == "fixed")
+        runBenchmarks<FixedDungeonGenerationEngine>(grid, options);
+    else
+    {
+        printUsage();
+        return 1;
+    }
+
+    return 0;
+}
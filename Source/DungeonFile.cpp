@@ -0,0 +1,198 @@
+/*
+  ==============================================================================
+
+    DungeonFile.cpp
+
+  ==============================================================================
+*/
+
+#include "DungeonFile.h"
+#include <cstring>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<DungeonFile::DungeonHeader>::value
+    && sizeof(DungeonFile::FileHeader) == 32
+    && sizeof(DungeonFile::IndexEntry) == 16
+    && sizeof(DungeonFile::DungeonHeader) == 104
+    && sizeof(DungeonFile::BoxRecord) == 32
+    && sizeof(DungeonFile::LineRecord) == 32
+    && sizeof(DungeonFile::EdgeRecord) == 8,
+    "DungeonFile records must match the on-disk layout");
+
+static constexpr size_t alignment = 8;
+
+static size_t alignUp(size_t n)
+{
+    return (n + alignment - 1) & ~(alignment - 1);
+}
+
+//==============================================================================
+DungeonFile::Writer::Writer(const juce::File& file)
+{
+    file.deleteFile();
+    stream = std::make_unique<juce::FileOutputStream>(file);
+    if (!stream->openedOk())
+        return;
+
+    // Placeholder, rewritten with the real counts by finish().
+    FileHeader header{};
+    writeAligned(&header, sizeof(header));
+}
+
+DungeonFile::Writer::~Writer()
+{
+    finish();
+}
+
+bool DungeonFile::Writer::writeAligned(const void* data, size_t numBytes)
+{
+    static const char padding[alignment] = {};
+    if (numBytes > 0 && !stream->write(data, numBytes))
+        return false;
+    return stream->write(padding, alignUp(numBytes) - numBytes);
+}
+
+bool DungeonFile::Writer::add(std::uint64_t seed, const DungeonGenerationEngine::Dungeon& dungeon)
+{
+    if (!openedOk() || finished)
+        return false;
+
+    auto toBoxes = [](const DungeonGenerationEngine::RoomBoxVec& boxes)
+    {
+        std::vector<BoxRecord> records;
+        records.reserve(boxes.size());
+        for (const auto& box : boxes)
+            records.push_back({ box.x, box.y, box.w, box.h });
+        return records;
+    };
+    auto rooms = toBoxes(dungeon.rooms);
+    auto corridors = toBoxes(dungeon.corridors);
+
+    std::vector<LineRecord> lines;
+    lines.reserve(dungeon.lines.size());
+    for (const auto& line : dungeon.lines)
+        lines.push_back({ std::get<0>(line), std::get<1>(line), std::get<2>(line), std::get<3>(line) });
+
+    std::vector<EdgeRecord> edges;
+    edges.reserve(dungeon.mst_edges.size());
+    for (const auto& e : dungeon.mst_edges)
+        edges.push_back({ e.first, e.second });
+
+    const auto& tiles = dungeon.tiles;
+    size_t numTileWords = tiles.empty() ? 0 : (size_t)tiles.getWordsPerRow() * tiles.getHeight();
+
+    DungeonHeader header{};
+    header.seed = seed;
+    header.mapWidth = (std::uint32_t)tiles.getWidth();
+    header.mapHeight = (std::uint32_t)tiles.getHeight();
+    header.tileWordsPerRow = (std::uint32_t)tiles.getWordsPerRow();
+
+    size_t offset = alignUp(sizeof(DungeonHeader));
+    auto place = [&offset](Section& section, size_t count, size_t recordSize)
+    {
+        section = { offset, count };
+        offset += alignUp(count * recordSize);
+    };
+    place(header.rooms, rooms.size(), sizeof(BoxRecord));
+    place(header.corridors, corridors.size(), sizeof(BoxRecord));
+    place(header.lines, lines.size(), sizeof(LineRecord));
+    place(header.edges, edges.size(), sizeof(EdgeRecord));
+    place(header.tiles, numTileWords, sizeof(std::uint64_t));
+
+    IndexEntry entry{ (std::uint64_t)stream->getPosition(), offset };
+    bool ok = writeAligned(&header, sizeof(header))
+        && writeAligned(rooms.data(), rooms.size() * sizeof(BoxRecord))
+        && writeAligned(corridors.data(), corridors.size() * sizeof(BoxRecord))
+        && writeAligned(lines.data(), lines.size() * sizeof(LineRecord))
+        && writeAligned(edges.data(), edges.size() * sizeof(EdgeRecord))
+        && writeAligned(numTileWords > 0 ? tiles.getRow(0) : nullptr, numTileWords * sizeof(std::uint64_t));
+    if (ok)
+        index.push_back(entry);
+    return ok;
+}
+
+bool DungeonFile::Writer::finish()
+{
+    if (!openedOk() || finished)
+        return finished;
+    finished = true;
+
+    FileHeader header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = currentVersion;
+    header.byteOrder = byteOrderMark;
+    header.numDungeons = index.size();
+    header.indexOffset = (std::uint64_t)stream->getPosition();
+
+    bool ok = writeAligned(index.data(), index.size() * sizeof(IndexEntry))
+        && stream->setPosition(0)
+        && stream->write(&header, sizeof(header));
+    stream->flush();
+    return ok && stream->getStatus().wasOk();
+}
+
+//==============================================================================
+DungeonFile::Reader::Reader(const juce::File& file)
+    : mapped(file, juce::MemoryMappedFile::readOnly)
+{
+    data = static_cast<const char*>(mapped.getData());
+    size = mapped.getSize();
+    if (data == nullptr || size < sizeof(FileHeader))
+        return;
+
+    header = reinterpret_cast<const FileHeader*>(data);
+    if (std::memcmp(header->magic, magic, sizeof(magic)) != 0
+        || header->version != currentVersion
+        || header->byteOrder != byteOrderMark
+        || header->indexOffset % alignment != 0
+        || header->indexOffset > size
+        || header->numDungeons > (size - header->indexOffset) / sizeof(IndexEntry))
+        return;
+
+    index = reinterpret_cast<const IndexEntry*>(data + header->indexOffset);
+    for (size_t i = 0; i < header->numDungeons; i++)
+        if (index[i].offset % alignment != 0 || index[i].offset > header->indexOffset
+            || index[i].size > header->indexOffset - index[i].offset
+            || index[i].size < sizeof(DungeonHeader))
+            return;
+    valid = true;
+}
+
+template <typename T>
+DungeonFile::Span<T> DungeonFile::Reader::getSection(const char* base, const Section& section) const
+{
+    if (section.count == 0)
+        return {};
+    return { reinterpret_cast<const T*>(base + section.offset), (size_t)section.count };
+}
+
+DungeonFile::DungeonView DungeonFile::Reader::getDungeon(size_t i) const
+{
+    jassert(i < getNumDungeons());
+    const char* base = data + index[i].offset;
+    const auto& h = *reinterpret_cast<const DungeonHeader*>(base);
+
+    // Reject sections that would run past this dungeon's extent.
+    auto inBounds = [&](const Section& s, size_t recordSize)
+    {
+        return s.offset % alignment == 0 && s.offset <= index[i].size
+            && s.count <= (index[i].size - s.offset) / recordSize;
+    };
+    if (!inBounds(h.rooms, sizeof(BoxRecord)) || !inBounds(h.corridors, sizeof(BoxRecord))
+        || !inBounds(h.lines, sizeof(LineRecord)) || !inBounds(h.edges, sizeof(EdgeRecord))
+        || !inBounds(h.tiles, sizeof(std::uint64_t))
+        || h.tiles.count != (std::uint64_t)h.tileWordsPerRow * h.mapHeight)
+        return {};
+
+    DungeonView view;
+    view.seed = h.seed;
+    view.mapWidth = (int)h.mapWidth;
+    view.mapHeight = (int)h.mapHeight;
+    view.rooms = getSection<BoxRecord>(base, h.rooms);
+    view.corridors = getSection<BoxRecord>(base, h.corridors);
+    view.lines = getSection<LineRecord>(base, h.lines);
+    view.edges = getSection<EdgeRecord>(base, h.edges);
+    view.tileWords = getSection<std::uint64_t>(base, h.tiles);
+    view.tileWordsPerRow = (int)h.tileWordsPerRow;
+    return view;
+}
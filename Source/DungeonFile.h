@@ -0,0 +1,173 @@
+/*
+  ==============================================================================
+
+    DungeonFile.h
+
+    Binary container for large pools of pre-generated dungeons. A file holds
+    any number of dungeons behind an offset index, and every section has a
+    fixed layout at an 8-byte aligned offset, so a reader can memory-map the
+    file and hand out views of dungeon N without parsing or copying.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "DungeonGenerationEngine.h"
+
+struct DungeonFile
+{
+    //==============================================================================
+    // On-disk layout, in the writing host's byte order so that views can point
+    // straight into the mapped file. FileHeader::byteOrder holds byteOrderMark
+    // as written, and a Reader on a host of the other byte order sees it
+    // swapped and rejects the file:
+    //
+    //   FileHeader
+    //   dungeon 0: DungeonHeader, rooms, corridors, lines, edges, tile words
+    //   dungeon 1: ...
+    //   IndexEntry[numDungeons]
+    //
+    // Section offsets in a DungeonHeader are relative to the start of that
+    // dungeon. Every record and section starts at a multiple of 8 bytes.
+
+    static constexpr char magic[8] = { 'D', 'U', 'N', 'G', 'E', 'O', 'N', '\0' };
+    static constexpr std::uint32_t currentVersion = 1;
+    static constexpr std::uint32_t byteOrderMark = 0x01020304;
+
+    struct FileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byteOrder;
+        std::uint64_t numDungeons;
+        std::uint64_t indexOffset;
+    };
+
+    struct IndexEntry
+    {
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+
+    struct Section
+    {
+        std::uint64_t offset;
+        std::uint64_t count;
+    };
+
+    struct DungeonHeader
+    {
+        std::uint64_t seed;
+        std::uint32_t mapWidth;
+        std::uint32_t mapHeight;
+        std::uint32_t tileWordsPerRow;
+        std::uint32_t reserved;
+        Section rooms;
+        Section corridors;
+        Section lines;
+        Section edges;
+        Section tiles;
+    };
+
+    struct BoxRecord
+    {
+        double x, y, w, h;
+    };
+
+    struct LineRecord
+    {
+        double x1, y1, x2, y2;
+    };
+
+    struct EdgeRecord
+    {
+        std::int32_t u, v;
+    };
+
+    //==============================================================================
+    template <typename T>
+    struct Span
+    {
+        const T* data = nullptr;
+        size_t count = 0;
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        const T* begin() const { return data; }
+        const T* end() const { return data + count; }
+        const T& operator[](size_t i) const { return data[i]; }
+    };
+
+    // A dungeon inside a mapped file; valid only while its Reader is alive.
+    struct DungeonView
+    {
+        std::uint64_t seed = 0;
+        int mapWidth = 0;
+        int mapHeight = 0;
+        Span<BoxRecord> rooms;
+        Span<BoxRecord> corridors;
+        Span<LineRecord> lines;
+        Span<EdgeRecord> edges;
+
+        // Packed 2-bit tiles in the TileGrid layout.
+        Span<std::uint64_t> tileWords;
+        int tileWordsPerRow = 0;
+
+        int getTile(int x, int y) const
+        {
+            auto word = tileWords[(size_t)y * tileWordsPerRow + x / DungeonGenerationEngine::TileGrid::tilesPerWord];
+            return (int)((word >> (DungeonGenerationEngine::TileGrid::bitsPerTile * (x % DungeonGenerationEngine::TileGrid::tilesPerWord))) & 3);
+        }
+    };
+
+    //==============================================================================
+    // Appends dungeons to a new file. The index is kept in memory (16 bytes per
+    // dungeon) and written by finish(), which also patches the header; a file
+    // that was never finished has no index and is rejected by the Reader.
+    class Writer
+    {
+    public:
+        explicit Writer(const juce::File& file);
+        ~Writer();
+
+        bool openedOk() const { return stream != nullptr && stream->openedOk(); }
+        bool add(std::uint64_t seed, const DungeonGenerationEngine::Dungeon& dungeon);
+        bool finish();
+
+    private:
+        bool writeAligned(const void* data, size_t numBytes);
+
+        std::unique_ptr<juce::FileOutputStream> stream;
+        std::vector<IndexEntry> index;
+        bool finished{ false };
+    };
+
+    //==============================================================================
+    class Reader
+    {
+    public:
+        explicit Reader(const juce::File& file);
+
+        // False if the file is missing, truncated, unfinished or from another
+        // version or byte order.
+        bool isValid() const { return valid; }
+        size_t getNumDungeons() const { return valid ? (size_t)header->numDungeons : 0; }
+        DungeonView getDungeon(size_t index) const;
+
+    private:
+        template <typename T>
+        Span<T> getSection(const char* base, const Section& section) const;
+
+        juce::MemoryMappedFile mapped;
+        const char* data{ nullptr };
+        size_t size{ 0 };
+        const FileHeader* header{ nullptr };
+        const IndexEntry* index{ nullptr };
+        bool valid{ false };
+    };
+};
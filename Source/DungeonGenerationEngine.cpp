@@ -8,19 +8,160 @@
   ==============================================================================
 */
 
+// Every platform must round the generator's arithmetic the same way, so a * b + c
+// is never fused into one FMA. Clang contracts within an expression by default
+// (and does so on arm64), hence the pragma; GCC ignores it and contracts across
+// statements, so the exporters also pass -ffp-contract=off. MSVC only contracts
+// under /fp:contract or /fp:fast.
+#if defined(__clang__)
+ #pragma STDC FP_CONTRACT OFF
+#endif
+
 #include "DungeonGenerationEngine.h"
-#include "delaunator.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#if defined(__AVX__)
+ #include <immintrin.h>
+ #define DUNGEON_GEN_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+ #include <emmintrin.h>
+ #define DUNGEON_GEN_SSE2 1
+#endif
 
 #define M_PI 3.14159265358979323846
 
-DungeonGenerationEngine::RoomBox::RoomBox(double cx, double cy, double w, double h)
+//==============================================================================
+std::array<std::uint32_t, 4> DungeonGenerationEngineBase::Philox::generate(std::array<std::uint32_t, 4> c, std::array<std::uint32_t, 2> k)
+{
+    constexpr std::uint32_t m0 = 0xD2511F53, m1 = 0xCD9E8D57;
+    constexpr std::uint32_t w0 = 0x9E3779B9, w1 = 0xBB67AE85;
+    for (int round = 0; round < 10; round++)
+    {
+        std::uint64_t p0 = (std::uint64_t)m0 * c[0];
+        std::uint64_t p1 = (std::uint64_t)m1 * c[2];
+        c = { (std::uint32_t)(p1 >> 32) ^ c[1] ^ k[0], (std::uint32_t)p1,
+              (std::uint32_t)(p0 >> 32) ^ c[3] ^ k[1], (std::uint32_t)p0 };
+        k[0] += w0;
+        k[1] += w1;
+    }
+    return c;
+}
+
+DungeonGenerationEngineBase::RandomStream::RandomStream(std::uint32_t seed, RandomStreamId stream, std::uint64_t index)
+    : key{ seed, (std::uint32_t)stream }, index(index)
+{
+}
+
+std::uint32_t DungeonGenerationEngineBase::RandomStream::nextUInt32()
+{
+    if (used == 4)
+    {
+        words = Philox::generate({ (std::uint32_t)block, (std::uint32_t)(block >> 32), (std::uint32_t)index, (std::uint32_t)(index >> 32) }, key);
+        block++;
+        used = 0;
+    }
+    return words[used++];
+}
+
+float DungeonGenerationEngineBase::RandomStream::nextFloat()
+{
+    return (float)(nextUInt32() >> 8) * (1.0f / 16777216.0f);
+}
+
+int DungeonGenerationEngineBase::RandomStream::nextInt(int a, int b)
+{
+    std::uint32_t range = (std::uint32_t)((std::int64_t)b - a) + 1u;
+    if (range == 0)
+        return (int)nextUInt32();
+    std::uint64_t m = (std::uint64_t)nextUInt32() * range;
+    if ((std::uint32_t)m < range)
+    {
+        std::uint32_t threshold = (0u - range) % range;
+        while ((std::uint32_t)m < threshold)
+            m = (std::uint64_t)nextUInt32() * range;
+    }
+    return (int)((std::int64_t)a + (std::int64_t)(m >> 32));
+}
+
+namespace
+{
+    // log and sin/cos from +, -, *, / and exact scaling only, so they round the
+    // same everywhere (libm implementations differ in the last bits).
+    double portableLog(double x)
+    {
+        // x = m * 2^e with m in [sqrt(1/2), sqrt(2)); log(m) = 2 atanh((m - 1) / (m + 1)).
+        int e = 0;
+        double m = std::frexp(x, &e);
+        if (m < 0.70710678118654752440)
+        {
+            m *= 2.0;
+            e--;
+        }
+        double z = (m - 1.0) / (m + 1.0);
+        double z2 = z * z;
+        double sum = 0.0;
+        for (int k = 21; k >= 1; k -= 2)
+            sum = sum * z2 + 1.0 / k;
+        return 2.0 * z * sum + e * 0.69314718055994530942;
+    }
+
+    // sin and cos of 2 * pi * turns.
+    std::pair<double, double> portableSinCos2Pi(double turns)
+    {
+        // Reduce to a quarter turn q and a remainder r in [-1/8, 1/8] turn.
+        double quarters = turns * 4.0;
+        double q = std::floor(quarters + 0.5);
+        double x = (quarters - q) * (M_PI / 2.0);
+        double x2 = x * x;
+        double sinX = 0.0, cosX = 0.0;
+        double term = x;
+        for (int k = 1; k <= 17; k += 2)
+        {
+            sinX += term;
+            term *= -x2 / ((k + 1) * (k + 2));
+        }
+        term = 1.0;
+        for (int k = 0; k <= 16; k += 2)
+        {
+            cosX += term;
+            term *= -x2 / ((k + 1) * (k + 2));
+        }
+        switch (((int)q % 4 + 4) % 4)
+        {
+        case 0: return { sinX, cosX };
+        case 1: return { cosX, -sinX };
+        case 2: return { -sinX, -cosX };
+        default: return { -cosX, sinX };
+        }
+    }
+}
+
+std::pair<float, float> DungeonGenerationEngineBase::RandomStream::nextNormalPair(float mu, float sigma)
+{
+    // u1 in (0, 1] keeps the log finite.
+    double u1 = 1.0 - nextFloat();
+    double u2 = nextFloat();
+    double r = std::sqrt(-2.0 * portableLog(u1));
+    auto sc = portableSinCos2Pi(u2);
+    return { (float)(mu + sigma * r * sc.second), (float)(mu + sigma * r * sc.first) };
+}
+
+template <typename Coord>
+BasicDungeonGenerationEngine<Coord>::RoomBox::RoomBox(double cx, double cy, double w, double h)
     : cx(cx), cy(cy), w(w), h(h)
 {
     x = cx - w / 2.0;
     y = cy - h / 2.0;
 }
 
-void DungeonGenerationEngine::RoomBox::snapToGrid()
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::RoomBox::snapToGrid()
 {
     x = (x < 0) ? floor(x) : ceil(x);
     y = (y < 0) ? floor(y) : ceil(y);
@@ -28,7 +169,8 @@ void DungeonGenerationEngine::RoomBox::snapToGrid()
     cy = y + h / 2.0;
 }
 
-void DungeonGenerationEngine::RoomBox::moveDelta(double dx, double dy)
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::RoomBox::moveDelta(double dx, double dy)
 {
     x += dx;
     y += dy;
@@ -36,61 +178,90 @@ void DungeonGenerationEngine::RoomBox::moveDelta(double dx, double dy)
     cy = y + h / 2.0;
 }
 
-bool DungeonGenerationEngine::RoomBox::operator<(const RoomBox& other) const
+template <typename Coord>
+bool BasicDungeonGenerationEngine<Coord>::RoomBox::operator<(const RoomBox& other) const
 {
     return getDistance() < other.getDistance();
 }
 
-double DungeonGenerationEngine::RoomBox::getDistance() const
+template <typename Coord>
+typename BasicDungeonGenerationEngine<Coord>::RoomBox::Distance BasicDungeonGenerationEngine<Coord>::RoomBox::getDistance() const
 {
     return sqrt(cx * cx + cy * cy);
 }
 
-double DungeonGenerationEngine::RoomBox::getHamiltonDist(const RoomBox& other) const
+template <typename Coord>
+double BasicDungeonGenerationEngine<Coord>::RoomBox::getHamiltonDist(const RoomBox& other) const
 {
-    return abs(cx - other.cx) + abs(cy - other.cy);
+    return std::abs(cx - other.cx) + std::abs(cy - other.cy);
 }
 
-double DungeonGenerationEngine::RoomBox::getSize() const
+template <typename Coord>
+double BasicDungeonGenerationEngine<Coord>::RoomBox::getSize() const
 {
     return w * h;
 }
 
-bool DungeonGenerationEngine::RoomBox::isOverlap(const RoomBox& other) const
+template <typename Coord>
+bool BasicDungeonGenerationEngine<Coord>::RoomBox::isOverlap(const RoomBox& other) const
 {
-    return abs(cx - other.cx) < w / 2 + other.w / 2 && abs(cy - other.cy) < h / 2 + other.h / 2;
+    return std::abs(cx - other.cx) < w / 2 + other.w / 2 && std::abs(cy - other.cy) < h / 2 + other.h / 2;
 }
 
-bool DungeonGenerationEngine::RoomBox::isTouching(const RoomBox& other) const
+template <typename Coord>
+bool BasicDungeonGenerationEngine<Coord>::RoomBox::isTouching(const RoomBox& other) const
 {
-    return abs(cx - other.cx) <= w / 2 + other.w / 2 && abs(cy - other.cy) <= h / 2 + other.h / 2;
+    return std::abs(cx - other.cx) <= w / 2 + other.w / 2 && std::abs(cy - other.cy) <= h / 2 + other.h / 2;
 }
 
-bool DungeonGenerationEngine::RoomBox::isTouchingLine(std::tuple<double, double, double, double> line)
+template <typename Coord>
+bool BasicDungeonGenerationEngine<Coord>::RoomBox::isTouchingLine(const std::tuple<double, double, double, double>& line) const
 {
     double x1, y1, x2, y2;
     std::tie(x1, y1, x2, y2) = line;
 
     return
-        (y1 == y2 && abs(y1 - cy) <= h / 2.0 && ((x1 <= cx && x2 >= cx || x1 >= cx && x2 <= cx) || abs(x1 - cx) < w / 2.0 || abs(x2 - cx) < w / 2.0)) ||
-        (x1 == x2 && abs(x1 - cx) <= w / 2.0 && ((y1 <= cy && y2 >= cy || y1 >= cy && y2 <= cy) || abs(y1 - cy) < h / 2.0 || abs(y2 - cy) < h / 2.0));
+        (y1 == y2 && std::abs(y1 - cy) <= h / 2.0 && ((x1 <= cx && x2 >= cx || x1 >= cx && x2 <= cx) || std::abs(x1 - cx) < w / 2.0 || std::abs(x2 - cx) < w / 2.0)) ||
+        (x1 == x2 && std::abs(x1 - cx) <= w / 2.0 && ((y1 <= cy && y2 >= cy || y1 >= cy && y2 <= cy) || std::abs(y1 - cy) < h / 2.0 || std::abs(y2 - cy) < h / 2.0));
 }
 
-std::pair<double, double> DungeonGenerationEngine::RoomBox::getDirection(const RoomBox& fixed) const
+template <typename Coord>
+std::pair<double, double> BasicDungeonGenerationEngine<Coord>::RoomBox::getDirection(const RoomBox& fixed) const
 {
     // Normalized direction
     double dx = cx - fixed.cx;
     double dy = cy - fixed.cy;
     if (dx == 0.0 && dy == 0.0)
     {
-        dx = 2 * static_cast<float>(rand()) / static_cast<float>(RAND_MAX) - 1;
-        dy = 2 * static_cast<float>(rand()) / static_cast<float>(RAND_MAX) - 1;
+        // Coincident centres: any direction will do, but it must not depend on
+        // global state, so it is drawn from a stream indexed by the pair of boxes.
+        const double values[4] = { cx, cy, w, fixed.w };
+        std::uint64_t bits[4];
+        std::memcpy(bits, values, sizeof(bits));
+        std::uint64_t index = 0;
+        for (auto b : bits)
+            index = (index ^ b) * 0x100000001B3ull;
+        RandomStream random(0, RandomStreamId::direction, index);
+        do
+        {
+            dx = 2.0 * random.nextFloat() - 1.0;
+            dy = 2.0 * random.nextFloat() - 1.0;
+        } while (dx == 0.0 && dy == 0.0);
     }
     double d = sqrt(dx * dx + dy * dy);
     return { dx / d, dy / d };
 }
 
-void DungeonGenerationEngine::RoomBox::moveAwayFrom(const RoomBox& fixed, double dirx, double diry)
+template <typename Coord>
+std::pair<double, double> BasicDungeonGenerationEngine<Coord>::RoomBox::getOutwardDirection() const
+{
+    double dirx = cx, diry = cy;
+    double norm = std::sqrt(dirx * dirx + diry * diry);
+    return { dirx / norm, diry / norm };
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::RoomBox::moveAwayFrom(const RoomBox& fixed, double dirx, double diry)
 {
     double targetX = 0;
     double targetY = 0;
@@ -146,7 +317,7 @@ void DungeonGenerationEngine::RoomBox::moveAwayFrom(const RoomBox& fixed, double
         double dx2 = (dy / diry) * dirx;
         double dy2 = (dx / dirx) * diry;
 
-        if (abs(dx) + abs(dy2) < abs(dx2) + abs(dy))
+        if (std::abs(dx) + std::abs(dy2) < std::abs(dx2) + std::abs(dy))
         {
             targetX = x + dx;
             targetY = y + dy2;
@@ -165,374 +336,1701 @@ void DungeonGenerationEngine::RoomBox::moveAwayFrom(const RoomBox& fixed, double
     cy = y + h / 2.0;
 }
 
-constexpr bool DungeonGenerationEngine::RoomBoxComp::operator()(const RoomBox& lhs, const RoomBox& rhs) const
+//==============================================================================
+// FixedCoord: the same box arithmetic on the raw Q23.8 values in 64-bit
+// integers. Positions are rounded exactly where the floating-point versions
+// round them, and the ratios they divide by are compared cross-multiplied.
+namespace
 {
-    return std::tie(lhs.cx, lhs.cy) < std::tie(rhs.cx, rhs.cy);
+    using FixedCoord = DungeonGenerationEngineBase::FixedCoord;
+    using FixedRoomBox = BasicDungeonGenerationEngine<FixedCoord>::RoomBox;
+
+    // Nearest multiple of 1 / scale to v, in those units. Boxes come from
+    // doubles only here: from the candidates randBox draws, and from offsets,
+    // directions and line ends that were whole numbers of these units already.
+    std::int64_t toRaw(double v, std::int64_t scale = FixedCoord::one)
+    {
+        return (std::int64_t)std::floor(v * (double)scale + 0.5);
+    }
+
+    std::int64_t floorDiv(std::int64_t a, std::int64_t b)
+    {
+        std::int64_t q = a / b;
+        return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+    }
+
+    std::int64_t ceilDiv(std::int64_t a, std::int64_t b)
+    {
+        return -floorDiv(-a, b);
+    }
+
+    // std::round(a / b): halves away from zero.
+    std::int64_t roundDiv(std::int64_t a, std::int64_t b)
+    {
+        return a < 0 ? -((-a + b / 2) / b) : (a + b / 2) / b;
+    }
+
+    // The position n / d raw units rounded to a whole tile away from zero
+    // (floor below zero, ceil otherwise), in raw units.
+    std::int64_t roundAwayToTile(std::int64_t n, std::int64_t d = 1)
+    {
+        if (d < 0)
+        {
+            n = -n;
+            d = -d;
+        }
+        d *= FixedCoord::one;
+        return (n < 0 ? floorDiv(n, d) : ceilDiv(n, d)) * FixedCoord::one;
+    }
+
+    std::int64_t absDiff(FixedCoord a, FixedCoord b)
+    {
+        return std::abs((std::int64_t)a.raw - b.raw);
+    }
+
+    // Sizes are whole tiles, so the centre is exactly x + w / 2.
+    FixedCoord centreOf(std::int64_t pos, FixedCoord size)
+    {
+        return FixedCoord::fromRaw(pos + size.raw / 2);
+    }
 }
-constexpr bool DungeonGenerationEngine::CustomTupleComp::operator()(const std::tuple<int, int, double>& lhs, const std::tuple<int, int, double>& rhs) const
+
+template <>
+BasicDungeonGenerationEngine<FixedCoord>::RoomBox::RoomBox(double cx, double cy, double w, double h)
+    : cx(FixedCoord::fromRaw(toRaw(cx))), cy(FixedCoord::fromRaw(toRaw(cy))), w(FixedCoord::fromRaw(toRaw(w))), h(FixedCoord::fromRaw(toRaw(h)))
 {
-    return std::tie(std::get<0>(lhs), std::get<1>(lhs)) < std::tie(std::get<0>(rhs), std::get<1>(rhs));
+    x = FixedCoord::fromRaw(this->cx.raw - this->w.raw / 2);
+    y = FixedCoord::fromRaw(this->cy.raw - this->h.raw / 2);
 }
 
+template <>
+void BasicDungeonGenerationEngine<FixedCoord>::RoomBox::snapToGrid()
+{
+    x = FixedCoord::fromRaw(roundAwayToTile(x.raw));
+    y = FixedCoord::fromRaw(roundAwayToTile(y.raw));
+    cx = centreOf(x.raw, w);
+    cy = centreOf(y.raw, h);
+}
 
-DungeonGenerationEngine::RoomBoxVec DungeonGenerationEngine::randBox(
-    unsigned int seed, bool useRectRegion, float radiusX, float radiusY,
-    unsigned int numBox, unsigned int maxIteration, float smallBoxProb,
-    bool smallBoxUseNormalDist, float smallBoxDistParamA, float smallBoxDistParamB, float smallBoxRatioLimit,
-    bool largeBoxUseNormalDist, float largeBoxDistParamA, float largeBoxDistParamB, float largeBoxRatioLimit,
-    float largeBoxRadiusMultiplier)
+template <>
+void BasicDungeonGenerationEngine<FixedCoord>::RoomBox::moveDelta(double dx, double dy)
 {
-    smallBoxDistParamA = std::max(0.0f, smallBoxDistParamA);
-    smallBoxDistParamB = std::max(0.0f, smallBoxDistParamB);
-    largeBoxDistParamA = std::max(0.0f, largeBoxDistParamA);
-    largeBoxDistParamB = std::max(0.0f, largeBoxDistParamB);
-    
-    if (!smallBoxUseNormalDist && smallBoxDistParamB < smallBoxDistParamA)
-        return {};
-    if (!largeBoxUseNormalDist && largeBoxDistParamB < largeBoxDistParamA)
-        return {};
+    x = FixedCoord::fromRaw(x.raw + toRaw(dx));
+    y = FixedCoord::fromRaw(y.raw + toRaw(dy));
+    cx = centreOf(x.raw, w);
+    cy = centreOf(y.raw, h);
+}
 
-    std::default_random_engine generator(seed);
-    std::uniform_real_distribution<float> pos_dist(0.0f, 1.0f);
-    std::uniform_real_distribution<float> choice_dist(0.0f, 1.0f);
-    std::uniform_int_distribution<int> unif_short_edge_dist((int)smallBoxDistParamA, (int)smallBoxDistParamB);
-    std::uniform_int_distribution<int> unif_long_edge_dist((int)largeBoxDistParamA, (int)largeBoxDistParamB);
-    std::normal_distribution<float> norm_short_edge_dist(smallBoxDistParamA, smallBoxDistParamB);
-    std::normal_distribution<float> norm_long_edge_dist(largeBoxDistParamA, largeBoxDistParamB);
+template <>
+BasicDungeonGenerationEngine<FixedCoord>::RoomBox::Distance BasicDungeonGenerationEngine<FixedCoord>::RoomBox::getDistance() const
+{
+    return (std::int64_t)cx.raw * cx.raw + (std::int64_t)cy.raw * cy.raw;
+}
 
-    RoomBoxVec boxes;
-    std::set<RoomBox, RoomBoxComp> boxSet;
+template <>
+double BasicDungeonGenerationEngine<FixedCoord>::RoomBox::getHamiltonDist(const RoomBox& other) const
+{
+    return (double)(absDiff(cx, other.cx) + absDiff(cy, other.cy)) / FixedCoord::one;
+}
 
-    radiusX = std::max(1.0f, radiusX);
-    radiusY = std::max(1.0f, radiusY);
-    largeBoxRadiusMultiplier = std::max(0.01f, largeBoxRadiusMultiplier);
+template <>
+double BasicDungeonGenerationEngine<FixedCoord>::RoomBox::getSize() const
+{
+    return (double)((std::int64_t)w.raw * h.raw) / ((double)FixedCoord::one * FixedCoord::one);
+}
+
+template <>
+bool BasicDungeonGenerationEngine<FixedCoord>::RoomBox::isOverlap(const RoomBox& other) const
+{
+    // |cx - other.cx| < w / 2 + other.w / 2, doubled so nothing is halved.
+    return 2 * absDiff(cx, other.cx) < (std::int64_t)w.raw + other.w.raw
+        && 2 * absDiff(cy, other.cy) < (std::int64_t)h.raw + other.h.raw;
+}
+
+template <>
+bool BasicDungeonGenerationEngine<FixedCoord>::RoomBox::isTouching(const RoomBox& other) const
+{
+    return 2 * absDiff(cx, other.cx) <= (std::int64_t)w.raw + other.w.raw
+        && 2 * absDiff(cy, other.cy) <= (std::int64_t)h.raw + other.h.raw;
+}
+
+template <>
+bool BasicDungeonGenerationEngine<FixedCoord>::RoomBox::isTouchingLine(const std::tuple<double, double, double, double>& line) const
+{
+    // In half raw units, where the corridor lines between FixedCoord rooms
+    // (centres, and midpoints of shared spans) fall on whole numbers.
+    constexpr std::int64_t scale = 2 * FixedCoord::one;
+    const std::int64_t x1 = toRaw(std::get<0>(line), scale), y1 = toRaw(std::get<1>(line), scale);
+    const std::int64_t x2 = toRaw(std::get<2>(line), scale), y2 = toRaw(std::get<3>(line), scale);
+    const std::int64_t bx = 2 * (std::int64_t)cx.raw, by = 2 * (std::int64_t)cy.raw;
+    const std::int64_t halfW = w.raw, halfH = h.raw;
+
+    return
+        (y1 == y2 && std::abs(y1 - by) <= halfH && (((x1 <= bx && x2 >= bx) || (x1 >= bx && x2 <= bx)) || std::abs(x1 - bx) < halfW || std::abs(x2 - bx) < halfW)) ||
+        (x1 == x2 && std::abs(x1 - bx) <= halfW && (((y1 <= by && y2 >= by) || (y1 >= by && y2 <= by)) || std::abs(y1 - by) < halfH || std::abs(y2 - by) < halfH));
+}
 
-    int i = 0;
-    while (i < numBox && i < maxIteration)
+template <>
+std::pair<double, double> BasicDungeonGenerationEngine<FixedCoord>::RoomBox::getDirection(const RoomBox& fixed) const
+{
+    std::int64_t dx = (std::int64_t)cx.raw - fixed.cx.raw;
+    std::int64_t dy = (std::int64_t)cy.raw - fixed.cy.raw;
+    if (dx == 0 && dy == 0)
     {
-        bool largeBox = false;
-        float w = 0, h = 0;
-        if (choice_dist(generator) < smallBoxProb)
+        const std::int32_t values[4] = { cx.raw, cy.raw, w.raw, fixed.w.raw };
+        std::uint64_t index = 0;
+        for (auto v : values)
+            index = (index ^ (std::uint32_t)v) * 0x100000001B3ull;
+        RandomStream random(0, RandomStreamId::direction, index);
+        do
         {
-            if (smallBoxUseNormalDist)
-            {
-                w = norm_short_edge_dist(generator);
-                h = norm_short_edge_dist(generator);
-            }
-            else
-            {
-                w = unif_short_edge_dist(generator);
-                h = unif_short_edge_dist(generator);
-            }
-            w = std::max(1.f, roundf(w));
-            h = std::max(1.f, roundf(h));
-            if (w / h > smallBoxRatioLimit || h / w > smallBoxRatioLimit)
-                continue;
-        }
+            dx = random.nextInt(-FixedCoord::one, FixedCoord::one);
+            dy = random.nextInt(-FixedCoord::one, FixedCoord::one);
+        } while (dx == 0 && dy == 0);
+    }
+    return { (double)dx, (double)dy };
+}
+
+template <>
+std::pair<double, double> BasicDungeonGenerationEngine<FixedCoord>::RoomBox::getOutwardDirection() const
+{
+    return { (double)cx.raw, (double)cy.raw };
+}
+
+template <>
+void BasicDungeonGenerationEngine<FixedCoord>::RoomBox::moveAwayFrom(const RoomBox& fixed, double dirx, double diry)
+{
+    const std::int64_t dirX = toRaw(dirx, 1);
+    const std::int64_t dirY = toRaw(diry, 1);
+    const std::int64_t right = (std::int64_t)fixed.x.raw + fixed.w.raw;
+    const std::int64_t left = (std::int64_t)fixed.x.raw - w.raw;
+    const std::int64_t below = (std::int64_t)fixed.y.raw + fixed.h.raw;
+    const std::int64_t above = (std::int64_t)fixed.y.raw - h.raw;
+    std::int64_t targetX = x.raw;
+    std::int64_t targetY = y.raw;
+
+    if (dirX == 0 || dirY == 0)
+    {
+        if (dirX > 0)
+            targetX = right;
+        else if (dirX < 0)
+            targetX = left;
+        else if (dirY > 0)
+            targetY = below;
+        else if (dirY < 0)
+            targetY = above;
         else
+            // A box centred on the origin; the floating-point engines divide 0 by 0 here.
+            throw std::runtime_error("Invalid direction");
+    }
+    else
+    {
+        targetX = dirX > 0 ? right : left;
+        targetY = dirY > 0 ? below : above;
+        const std::int64_t dx = targetX - x.raw;
+        const std::int64_t dy = targetY - y.raw;
+
+        // Either all of dx and dy2 = dx * dirY / dirX, or dx2 = dy * dirX / dirY
+        // and all of dy, whichever is shorter: |dx| + |dy2| < |dx2| + |dy|
+        // reduces to |dx * dirY| < |dy * dirX|.
+        if (std::abs(dx) * std::abs(dirY) < std::abs(dy) * std::abs(dirX))
         {
-            if (largeBoxUseNormalDist)
-            {
-                w = norm_long_edge_dist(generator);
-                h = norm_long_edge_dist(generator);
-            }
-            else
-            {
-                w = unif_long_edge_dist(generator);
-                h = unif_long_edge_dist(generator);
-            }
-            w = std::max(1.f, roundf(w));
-            h = std::max(1.f, roundf(h));
-            if ((float)w / h > largeBoxRatioLimit || (float)h / w > largeBoxRatioLimit)
-                continue;
-            largeBox = true;
-        }
-        double cx = 0, cy = 0;
-        if (useRectRegion)
-        {
-            cx = (pos_dist(generator) - 0.5) * 2.0 * radiusX;
-            cy = (pos_dist(generator) - 0.5) * 2.0 * radiusY;
+            targetX = roundAwayToTile(targetX);
+            targetY = roundAwayToTile(y.raw * dirX + dx * dirY, dirX);
         }
         else
         {
-            double t = 2 * M_PI * pos_dist(generator);
-            double u = std::sqrt(pos_dist(generator));
-            if (largeBox)
-                u *= largeBoxRadiusMultiplier;
-            cx = radiusX * u * std::cos(t);
-            cy = radiusY * u * std::sin(t);
+            targetX = roundAwayToTile(x.raw * dirY + dy * dirX, dirY);
+            targetY = roundAwayToTile(targetY);
         }
-        RoomBox box(cx, cy, (int)w, (int)h);
-        auto result = boxSet.insert(box);
-        if (result.second)
-            i++;
     }
-    for (auto& box : boxSet)
-        boxes.push_back(box);
-    std::sort(boxes.begin(), boxes.end());
-    boxes[0].snapToGrid();
+    x = FixedCoord::fromRaw(targetX);
+    y = FixedCoord::fromRaw(targetY);
+    cx = centreOf(x.raw, w);
+    cy = centreOf(y.raw, h);
+}
 
-    return boxes;
+template <typename Coord>
+BasicDungeonGenerationEngine<Coord>::RoomBoxSoA::RoomBoxSoA(const std::vector<RoomBox>& boxes)
+{
+    assign(boxes);
 }
 
-DungeonGenerationEngine::RoomBoxVec DungeonGenerationEngine::separateBox(RoomBoxVec boxes)
+template <typename Coord>
+std::vector<typename BasicDungeonGenerationEngine<Coord>::RoomBox> BasicDungeonGenerationEngine<Coord>::RoomBoxSoA::toVec() const
 {
-    bool overlapped = true;
-    for (int round = 0; round < 10 && overlapped; round++)
-    {
-        for (int current = 1; current < boxes.size(); current++)
-        {
-            double dirx = boxes[current].cx, diry = boxes[current].cy;
-            //bool overlapped = true;
-            //for (int fidx = 0; fidx < current; fidx++)
-            //{
-            //    if (boxes[current].isOverlap(boxes[fidx]))
-            //    {
-            //        overlapped = true;
-            //        auto dir = boxes[current].getDirection(boxes[fidx]);
-            //        DBG("Overlap " << fidx << " dir:" << dir.first << "," << dir.second);
-            //        if (dirx + dir.first == 0.0 && diry + dir.second == 0.0)
-            //            continue;
-            //        else
-            //        {
-            //            dirx += dir.first;
-            //            diry += dir.second;
-            //        }
-            //        DBG("Now dir: " << dirx << "," << diry);
-            //    }
-            //}
-            double norm = std::sqrt(dirx * dirx + diry * diry);
-            dirx /= norm;
-            diry /= norm;
-            for (int fidx = 0; fidx < current; fidx++)
-            {
-                if (boxes[current].isOverlap(boxes[fidx]))
-                {
-                    overlapped = true;
-                    boxes[current].moveAwayFrom(boxes[fidx], dirx, diry);
-                }
-            }
-        }
-    }
+    std::vector<RoomBox> boxes;
+    copyTo(boxes);
     return boxes;
 }
 
-DungeonGenerationEngine::RoomBoxVec DungeonGenerationEngine::centerAndCropBox(RoomBoxVec boxes, unsigned int mapWidth, unsigned int mapHeight)
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::RoomBoxSoA::assign(const std::vector<RoomBox>& boxes)
 {
-    if (boxes.size() == 0)
-        return boxes;
-    
-    double centerX = 0.0, centerY = 0.0;
-    for (auto& box : boxes)
-    {
-        centerX += box.cx;
-        centerY += box.cy;
-    }
-    centerX /= boxes.size();
-    centerY /= boxes.size();
-    centerX = std::round(centerX);
-    centerY = std::round(centerY);
+    clear();
+    reserve(boxes.size());
+    for (const auto& box : boxes)
+        push_back(box);
+}
 
-    RoomBoxVec filtered;
-    for (auto& box : boxes)
-    {
-        box.moveDelta(-centerX, -centerY);
-        if (box.x < -((int)mapWidth / 2) || box.y < -((int)mapHeight / 2) ||
-            box.x + box.w >(int)mapWidth / 2 || box.y + box.h >(int)mapHeight / 2)
-            continue;
-        filtered.push_back(box);
-    }
-    return filtered;
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::RoomBoxSoA::copyTo(std::vector<RoomBox>& boxes) const
+{
+    boxes.clear();
+    boxes.reserve(size());
+    for (size_t i = 0; i < size(); i++)
+        boxes.push_back(get(i));
 }
 
-std::pair<DungeonGenerationEngine::RoomBoxVec, DungeonGenerationEngine::RoomBoxVec> DungeonGenerationEngine::randSelect(RoomBoxVec boxes, unsigned int numRooms, bool allowTouching)
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::RoomBoxSoA::reserve(size_t n)
 {
-    std::sort(boxes.begin(), boxes.end(), [](const RoomBox& a, const RoomBox& b) { return a.getSize() > b.getSize(); });
+    for (auto* v : { &x, &cx, &y, &cy, &w, &h })
+        v->reserve(n);
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::RoomBoxSoA::clear()
+{
+    for (auto* v : { &x, &cx, &y, &cy, &w, &h })
+        v->clear();
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::RoomBoxSoA::push_back(const RoomBox& box)
+{
+    x.push_back(box.x);
+    cx.push_back(box.cx);
+    y.push_back(box.y);
+    cy.push_back(box.cy);
+    w.push_back(box.w);
+    h.push_back(box.h);
+}
+
+template <typename Coord>
+typename BasicDungeonGenerationEngine<Coord>::RoomBox BasicDungeonGenerationEngine<Coord>::RoomBoxSoA::get(size_t i) const
+{
+    RoomBox box(cx[i], cy[i], w[i], h[i]);
+    box.x = x[i];
+    box.y = y[i];
+    return box;
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::RoomBoxSoA::set(size_t i, const RoomBox& box)
+{
+    x[i] = box.x;
+    cx[i] = box.cx;
+    y[i] = box.y;
+    cy[i] = box.cy;
+    w[i] = box.w;
+    h[i] = box.h;
+}
 
-    RoomBoxVec rooms;
-    auto it = boxes.begin();
-    while (it != boxes.end() && numRooms > 0)
+// Vector prefix of findFirstIntersecting: tests boxes from i onwards a register
+// at a time, leaving i at the first box it did not test.
+template <bool inclusive>
+static size_t findFirstIntersectingSimd(const double* cx, const double* cy, const double* w, const double* h,
+    double boxCx, double boxCy, double boxW, double boxH, size_t& i, size_t end)
+{
+#if DUNGEON_GEN_AVX
+    const __m256d signMask = _mm256_set1_pd(-0.0);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d bcx = _mm256_set1_pd(boxCx);
+    const __m256d bcy = _mm256_set1_pd(boxCy);
+    const __m256d bhw = _mm256_set1_pd(boxW / 2);
+    const __m256d bhh = _mm256_set1_pd(boxH / 2);
+    for (; i + 4 <= end; i += 4)
     {
-        bool touching = false;
-        if (!allowTouching)
-            for (const auto& room : rooms)
-                touching |= room.isTouching(*it);
-        if (!touching)
-        {
-            rooms.push_back(*it);
-            it = boxes.erase(it);
-            numRooms--;
-        }
-        else
-            it++;
+        __m256d dx = _mm256_andnot_pd(signMask, _mm256_sub_pd(bcx, _mm256_loadu_pd(cx + i)));
+        __m256d dy = _mm256_andnot_pd(signMask, _mm256_sub_pd(bcy, _mm256_loadu_pd(cy + i)));
+        __m256d limx = _mm256_add_pd(bhw, _mm256_mul_pd(_mm256_loadu_pd(w + i), half));
+        __m256d limy = _mm256_add_pd(bhh, _mm256_mul_pd(_mm256_loadu_pd(h + i), half));
+        __m256d mask = inclusive
+            ? _mm256_and_pd(_mm256_cmp_pd(dx, limx, _CMP_LE_OQ), _mm256_cmp_pd(dy, limy, _CMP_LE_OQ))
+            : _mm256_and_pd(_mm256_cmp_pd(dx, limx, _CMP_LT_OQ), _mm256_cmp_pd(dy, limy, _CMP_LT_OQ));
+        int bits = _mm256_movemask_pd(mask);
+        if (bits != 0)
+            for (int k = 0; k < 4; k++)
+                if (bits & (1 << k))
+                    return i + k;
     }
-    return std::make_pair(boxes, rooms);
+#elif DUNGEON_GEN_SSE2
+    const __m128d signMask = _mm_set1_pd(-0.0);
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d bcx = _mm_set1_pd(boxCx);
+    const __m128d bcy = _mm_set1_pd(boxCy);
+    const __m128d bhw = _mm_set1_pd(boxW / 2);
+    const __m128d bhh = _mm_set1_pd(boxH / 2);
+    for (; i + 2 <= end; i += 2)
+    {
+        __m128d dx = _mm_andnot_pd(signMask, _mm_sub_pd(bcx, _mm_loadu_pd(cx + i)));
+        __m128d dy = _mm_andnot_pd(signMask, _mm_sub_pd(bcy, _mm_loadu_pd(cy + i)));
+        __m128d limx = _mm_add_pd(bhw, _mm_mul_pd(_mm_loadu_pd(w + i), half));
+        __m128d limy = _mm_add_pd(bhh, _mm_mul_pd(_mm_loadu_pd(h + i), half));
+        __m128d mask = inclusive
+            ? _mm_and_pd(_mm_cmple_pd(dx, limx), _mm_cmple_pd(dy, limy))
+            : _mm_and_pd(_mm_cmplt_pd(dx, limx), _mm_cmplt_pd(dy, limy));
+        int bits = _mm_movemask_pd(mask);
+        if (bits & 1)
+            return i;
+        if (bits & 2)
+            return i + 1;
+    }
+#endif
+    return end;
 }
 
-DungeonGenerationEngine::WeightedEdgeSet DungeonGenerationEngine::triangulate(const RoomBoxVec& rooms)
+template <bool inclusive>
+static size_t findFirstIntersectingSimd(const float* cx, const float* cy, const float* w, const float* h,
+    float boxCx, float boxCy, float boxW, float boxH, size_t& i, size_t end)
 {
-    WeightedEdgeSet edges;
-    std::vector<double> coords;
-    for (const auto& room : rooms)
+#if DUNGEON_GEN_AVX
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 bcx = _mm256_set1_ps(boxCx);
+    const __m256 bcy = _mm256_set1_ps(boxCy);
+    const __m256 bhw = _mm256_set1_ps(boxW / 2);
+    const __m256 bhh = _mm256_set1_ps(boxH / 2);
+    for (; i + 8 <= end; i += 8)
     {
-        coords.push_back(room.cx);
-        coords.push_back(room.cy);
+        __m256 dx = _mm256_andnot_ps(signMask, _mm256_sub_ps(bcx, _mm256_loadu_ps(cx + i)));
+        __m256 dy = _mm256_andnot_ps(signMask, _mm256_sub_ps(bcy, _mm256_loadu_ps(cy + i)));
+        __m256 limx = _mm256_add_ps(bhw, _mm256_mul_ps(_mm256_loadu_ps(w + i), half));
+        __m256 limy = _mm256_add_ps(bhh, _mm256_mul_ps(_mm256_loadu_ps(h + i), half));
+        __m256 mask = inclusive
+            ? _mm256_and_ps(_mm256_cmp_ps(dx, limx, _CMP_LE_OQ), _mm256_cmp_ps(dy, limy, _CMP_LE_OQ))
+            : _mm256_and_ps(_mm256_cmp_ps(dx, limx, _CMP_LT_OQ), _mm256_cmp_ps(dy, limy, _CMP_LT_OQ));
+        int bits = _mm256_movemask_ps(mask);
+        if (bits != 0)
+            for (int k = 0; k < 8; k++)
+                if (bits & (1 << k))
+                    return i + k;
+    }
+#elif DUNGEON_GEN_SSE2
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 bcx = _mm_set1_ps(boxCx);
+    const __m128 bcy = _mm_set1_ps(boxCy);
+    const __m128 bhw = _mm_set1_ps(boxW / 2);
+    const __m128 bhh = _mm_set1_ps(boxH / 2);
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 dx = _mm_andnot_ps(signMask, _mm_sub_ps(bcx, _mm_loadu_ps(cx + i)));
+        __m128 dy = _mm_andnot_ps(signMask, _mm_sub_ps(bcy, _mm_loadu_ps(cy + i)));
+        __m128 limx = _mm_add_ps(bhw, _mm_mul_ps(_mm_loadu_ps(w + i), half));
+        __m128 limy = _mm_add_ps(bhh, _mm_mul_ps(_mm_loadu_ps(h + i), half));
+        __m128 mask = inclusive
+            ? _mm_and_ps(_mm_cmple_ps(dx, limx), _mm_cmple_ps(dy, limy))
+            : _mm_and_ps(_mm_cmplt_ps(dx, limx), _mm_cmplt_ps(dy, limy));
+        int bits = _mm_movemask_ps(mask);
+        if (bits != 0)
+            for (int k = 0; k < 4; k++)
+                if (bits & (1 << k))
+                    return i + k;
     }
+#endif
+    return end;
+}
 
-    if (rooms.size() == 2)
+// FixedCoord tests 2 * |cx - other.cx| < w + other.w in 32-bit lanes, which
+// cannot overflow within the coordinate range, and finishes with the same test
+// in scalar code, so the generic loop after it has nothing left to do.
+template <bool inclusive>
+static size_t findFirstIntersectingSimd(const FixedCoord* cx, const FixedCoord* cy, const FixedCoord* w, const FixedCoord* h,
+    FixedCoord boxCx, FixedCoord boxCy, FixedCoord boxW, FixedCoord boxH, size_t& i, size_t end)
+{
+#if DUNGEON_GEN_AVX || DUNGEON_GEN_SSE2
+    const __m128i bcx = _mm_set1_epi32(boxCx.raw);
+    const __m128i bcy = _mm_set1_epi32(boxCy.raw);
+    const __m128i bw = _mm_set1_epi32(boxW.raw);
+    const __m128i bh = _mm_set1_epi32(boxH.raw);
+    auto load = [](const FixedCoord* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); };
+    auto twiceAbs = [](__m128i v)
+    {
+        __m128i sign = _mm_srai_epi32(v, 31);
+        return _mm_slli_epi32(_mm_sub_epi32(_mm_xor_si128(v, sign), sign), 1);
+    };
+    for (; i + 4 <= end; i += 4)
     {
-        edges.insert({ 0, 1, rooms[0].getHamiltonDist(rooms[1]) });
-        edges.insert({ 1, 0, rooms[0].getHamiltonDist(rooms[1]) });
+        __m128i dx = twiceAbs(_mm_sub_epi32(bcx, load(cx + i)));
+        __m128i dy = twiceAbs(_mm_sub_epi32(bcy, load(cy + i)));
+        __m128i limx = _mm_add_epi32(bw, load(w + i));
+        __m128i limy = _mm_add_epi32(bh, load(h + i));
+        // SSE2 only compares greater-than: dx <= limx is !(dx > limx).
+        int bits = inclusive
+            ? ~_mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(_mm_cmpgt_epi32(dx, limx), _mm_cmpgt_epi32(dy, limy)))) & 0xF
+            : _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(limx, dx), _mm_cmpgt_epi32(limy, dy))));
+        if (bits != 0)
+            for (int k = 0; k < 4; k++)
+                if (bits & (1 << k))
+                    return i + k;
     }
-    else if (rooms.size() > 2)
+#endif
+    for (; i < end; i++)
     {
-        delaunator::Delaunator d(coords);
-        for (std::size_t i = 0; i < d.triangles.size(); i += 3)
-        {
-            edges.insert({ d.triangles[i], d.triangles[i + 1], rooms[d.triangles[i]].getHamiltonDist(rooms[d.triangles[i + 1]]) });
-            edges.insert({ d.triangles[i + 1], d.triangles[i + 2], rooms[d.triangles[i + 1]].getHamiltonDist(rooms[d.triangles[i + 2]]) });
-            edges.insert({ d.triangles[i + 2], d.triangles[i], rooms[d.triangles[i + 2]].getHamiltonDist(rooms[d.triangles[i]]) });
-
-            edges.insert({ d.triangles[i + 1], d.triangles[i], rooms[d.triangles[i]].getHamiltonDist(rooms[d.triangles[i + 1]]) });
-            edges.insert({ d.triangles[i + 2], d.triangles[i + 1], rooms[d.triangles[i + 1]].getHamiltonDist(rooms[d.triangles[i + 2]]) });
-            edges.insert({ d.triangles[i], d.triangles[i + 2], rooms[d.triangles[i + 2]].getHamiltonDist(rooms[d.triangles[i]]) });
-        }
+        std::int64_t dx = 2 * absDiff(boxCx, cx[i]);
+        std::int64_t dy = 2 * absDiff(boxCy, cy[i]);
+        std::int64_t limx = (std::int64_t)boxW.raw + w[i].raw;
+        std::int64_t limy = (std::int64_t)boxH.raw + h[i].raw;
+        if (inclusive ? (dx <= limx && dy <= limy) : (dx < limx && dy < limy))
+            return i;
     }
-    return edges;
+    return end;
 }
 
-DungeonGenerationEngine::EdgeSet DungeonGenerationEngine::mst(const WeightedEdgeSet& edges)
+template <bool inclusive, typename Coord>
+static size_t findFirstIntersecting(const typename BasicDungeonGenerationEngine<Coord>::RoomBoxSoA& boxes,
+    const typename BasicDungeonGenerationEngine<Coord>::RoomBox& box, size_t begin, size_t end)
 {
-    using iPair = std::pair<int, double>;
+    // |cx - other.cx| < w / 2 + other.w / 2 on both axes (<= when inclusive).
+    // w * 0.5 is exactly w / 2, so every lane matches the scalar RoomBox test.
+    const Coord* cx = boxes.cx.data();
+    const Coord* cy = boxes.cy.data();
+    const Coord* w = boxes.w.data();
+    const Coord* h = boxes.h.data();
+    size_t i = begin;
 
-    if (edges.size() == 0)
-        return {};
+    size_t found = findFirstIntersectingSimd<inclusive>(cx, cy, w, h, box.cx, box.cy, box.w, box.h, i, end);
+    if (found != end)
+        return found;
 
-    std::set<int> nodes;
-    for (const auto& e : edges)
+    for (; i < end; i++)
     {
-        nodes.insert(std::get<0>(e));
-        nodes.insert(std::get<1>(e));
+        auto dx = std::abs(box.cx - cx[i]);
+        auto dy = std::abs(box.cy - cy[i]);
+        auto limx = box.w / 2 + w[i] / 2;
+        auto limy = box.h / 2 + h[i] / 2;
+        if (inclusive ? (dx <= limx && dy <= limy) : (dx < limx && dy < limy))
+            return i;
     }
+    return end;
+}
 
-    unsigned int numRooms = nodes.size();
-    std::set<std::pair<int, int>> mst_edges;
-    std::vector<std::vector<iPair>> adj;
-    adj.resize(numRooms);
-    for (const auto& e : edges)
-    {
-        int u, v;
-        double w;
-        std::tie(u, v, w) = e;
+template <typename Coord>
+size_t BasicDungeonGenerationEngine<Coord>::RoomBoxSoA::findFirstOverlap(const RoomBox& box, size_t begin, size_t end) const
+{
+    return findFirstIntersecting<false, Coord>(*this, box, begin, end);
+}
 
-        adj[u].push_back({ v, w });
-    }
+template <typename Coord>
+size_t BasicDungeonGenerationEngine<Coord>::RoomBoxSoA::findFirstTouching(const RoomBox& box, size_t begin, size_t end) const
+{
+    return findFirstIntersecting<true, Coord>(*this, box, begin, end);
+}
 
-    std::priority_queue<iPair, std::vector<iPair>, std::greater<iPair>> pq;
-    int src = 0;
-    std::vector<double> key(numRooms, std::numeric_limits<double>::max());
-    std::vector<int> parent(numRooms, -1);
-    std::vector<bool> inMst(numRooms, false);
+template <typename Coord>
+BasicDungeonGenerationEngine<Coord>::BoxGrid::BoxGrid(double cellSize)
+    : cellSize(std::max(1.0, cellSize))
+{
+}
 
-    pq.push({ 0.0, src });
-    key[src] = 0.0;
-    while (!pq.empty())
-    {
-        int u = pq.top().second;
-        pq.pop();
-        if (inMst[u] == true) {
-            continue;
-        }
-        inMst[u] = true;
+template <typename Coord>
+double BasicDungeonGenerationEngine<Coord>::BoxGrid::suggestCellSize(const std::vector<RoomBox>& boxes)
+{
+    if (boxes.empty())
+        return 1.0;
+    double sum = 0.0;
+    for (const auto& box : boxes)
+        sum += std::max(box.w, box.h);
+    return std::ceil(2.0 * sum / boxes.size());
+}
 
-        for (const auto& neigh : adj[u])
-        {
-            int v = neigh.first;
-            int weight = neigh.second;
+template <typename Coord>
+double BasicDungeonGenerationEngine<Coord>::BoxGrid::suggestCellSize(const RoomBoxSoA& boxes)
+{
+    if (boxes.size() == 0)
+        return 1.0;
+    double sum = 0.0;
+    for (size_t i = 0; i < boxes.size(); i++)
+        sum += std::max(boxes.w[i], boxes.h[i]);
+    return std::ceil(2.0 * sum / boxes.size());
+}
 
-            if (inMst[v] == false && key[v] > weight)
-            {
-                key[v] = weight;
-                pq.push({ key[v], v });
-                parent[v] = u;
-            }
-        }
-    }
-    for (int i = 1; i < numRooms; i++)
-        mst_edges.insert({ i, parent[i] });
-    return mst_edges;
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::BoxGrid::reset(double newCellSize)
+{
+    cellSize = std::max(1.0, newCellSize);
+    for (size_t i = 0; i < numCells; i++)
+        cellLists[i].clear();
+    numCells = 0;
+    std::fill(table.begin(), table.end(), Slot{ 0, -1 });
 }
 
-DungeonGenerationEngine::EdgeSet DungeonGenerationEngine::addSomeEdgesBack(
-    unsigned int seed,
-    const WeightedEdgeSet& edges,
-    EdgeSet mst_edges,
-    float addBackProb)
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::BoxGrid::cellRange(const RoomBox& box, int& x0, int& y0, int& x1, int& y1) const
+{
+    // Padded so boxes that merely touch still share a cell; callers do the exact test.
+    constexpr double pad = 1e-6;
+    x0 = (int)std::floor((box.cx - box.w / 2.0 - pad) / cellSize);
+    y0 = (int)std::floor((box.cy - box.h / 2.0 - pad) / cellSize);
+    x1 = (int)std::floor((box.cx + box.w / 2.0 + pad) / cellSize);
+    y1 = (int)std::floor((box.cy + box.h / 2.0 + pad) / cellSize);
+}
+
+template <typename Coord>
+long long BasicDungeonGenerationEngine<Coord>::BoxGrid::cellKey(int x, int y)
+{
+    return ((long long)x << 32) | (unsigned int)y;
+}
+
+static size_t cellSlot(long long key, size_t mask)
 {
-    using Edge = std::tuple<int, int, double>;
+    auto h = (std::uint64_t)key * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h ^ (h >> 32)) & mask;
+}
 
-    std::default_random_engine generator(seed);
-    std::uniform_real_distribution<float> choice_dist(0.0f, 1.0f);
+template <typename Coord>
+int BasicDungeonGenerationEngine<Coord>::BoxGrid::findCell(long long key) const
+{
+    if (table.empty())
+        return -1;
+    const size_t mask = table.size() - 1;
+    for (size_t i = cellSlot(key, mask);; i = (i + 1) & mask)
+    {
+        if (table[i].list < 0 || table[i].key == key)
+            return table[i].list;
+    }
+}
 
-    for (const auto& e : edges)
+template <typename Coord>
+std::vector<int>& BasicDungeonGenerationEngine<Coord>::BoxGrid::getOrAddCell(long long key)
+{
+    if ((numCells + 1) * 2 > table.size())
+        growTable();
+    const size_t mask = table.size() - 1;
+    for (size_t i = cellSlot(key, mask);; i = (i + 1) & mask)
     {
-        int na, nb;
-        double w;
-        std::tie(na, nb, w) = e;
-        if (mst_edges.find({ na, nb }) == mst_edges.end()
-            && mst_edges.find({ nb, na }) == mst_edges.end()
-            && choice_dist(generator) < addBackProb)
+        if (table[i].list >= 0)
         {
-            mst_edges.insert({ na, nb });
+            if (table[i].key == key)
+                return cellLists[table[i].list];
+            continue;
         }
+        if (numCells == cellLists.size())
+            cellLists.emplace_back();
+        table[i] = { key, (int)numCells };
+        return cellLists[numCells++];
     }
-    return mst_edges;
 }
 
-DungeonGenerationEngine::LineSet DungeonGenerationEngine::lineConnect(
-    unsigned int seed,
-    const RoomBoxVec& rooms, const EdgeSet& mst_edges,
-    unsigned int overlapPadding, bool addBothDirection, float firstHorizontalProb)
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::BoxGrid::growTable()
 {
-    LineSet lines;
+    std::vector<Slot> old(std::max<size_t>(64, table.size() * 2), Slot{ 0, -1 });
+    old.swap(table);
+    const size_t mask = table.size() - 1;
+    for (const auto& slot : old)
+    {
+        if (slot.list < 0)
+            continue;
+        size_t i = cellSlot(slot.key, mask);
+        while (table[i].list >= 0)
+            i = (i + 1) & mask;
+        table[i] = slot;
+    }
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::BoxGrid::insert(int idx, const RoomBox& box)
+{
+    int x0, y0, x1, y1;
+    cellRange(box, x0, y0, x1, y1);
+    for (int y = y0; y <= y1; y++)
+        for (int x = x0; x <= x1; x++)
+            getOrAddCell(cellKey(x, y)).push_back(idx);
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::BoxGrid::remove(int idx, const RoomBox& box)
+{
+    int x0, y0, x1, y1;
+    cellRange(box, x0, y0, x1, y1);
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            int cell = findCell(cellKey(x, y));
+            if (cell < 0)
+                continue;
+            auto& ids = cellLists[cell];
+            auto it = std::find(ids.begin(), ids.end(), idx);
+            if (it != ids.end())
+            {
+                *it = ids.back();
+                ids.pop_back();
+            }
+        }
+    }
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::BoxGrid::query(const RoomBox& box, std::vector<int>& result) const
+{
+    int x0, y0, x1, y1;
+    cellRange(box, x0, y0, x1, y1);
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            int cell = findCell(cellKey(x, y));
+            if (cell >= 0)
+                result.insert(result.end(), cellLists[cell].begin(), cellLists[cell].end());
+        }
+    }
+}
+
+DungeonGenerationEngineBase::TileGrid::TileGrid(int width, int height)
+    : width(width), height(height),
+    wordsPerRow((width + tilesPerWord - 1) / tilesPerWord),
+    words((size_t)wordsPerRow * height, 0)
+{
+}
+
+void DungeonGenerationEngineBase::TileGrid::reset(int newWidth, int newHeight)
+{
+    width = newWidth;
+    height = newHeight;
+    wordsPerRow = (width + tilesPerWord - 1) / tilesPerWord;
+    words.assign((size_t)wordsPerRow * height, 0);
+}
+
+void DungeonGenerationEngineBase::TileGrid::fillRowSpan(int y, int x0, int x1, int value)
+{
+    fillRect(x0, y, x1, y + 1, value);
+}
+
+void DungeonGenerationEngineBase::TileGrid::fillRect(int x0, int y0, int x1, int y1, int value)
+{
+    if (x0 >= x1 || y0 >= y1)
+        return;
+    // Broadcast the 2-bit value to every lane, then blend it in under a mask for
+    // the partial words at either end and store whole words in between.
+    const std::uint64_t pattern = (std::uint64_t)(value & 3) * 0x5555555555555555ull;
+    int firstWord = x0 / tilesPerWord;
+    int lastWord = (x1 - 1) / tilesPerWord;
+    auto maskFrom = [](int tile) { return ~0ull << (bitsPerTile * tile); };
+    auto maskTo = [](int tile) { return tile >= tilesPerWord ? ~0ull : ~(~0ull << (bitsPerTile * tile)); };
+    auto* row = words.data() + (size_t)y0 * wordsPerRow;
+
+    if (firstWord == lastWord)
+    {
+        auto mask = maskFrom(x0 % tilesPerWord) & maskTo(x1 - firstWord * tilesPerWord);
+        for (int y = y0; y < y1; y++, row += wordsPerRow)
+            row[firstWord] = (row[firstWord] & ~mask) | (pattern & mask);
+        return;
+    }
+    auto head = maskFrom(x0 % tilesPerWord);
+    auto tail = maskTo(x1 - lastWord * tilesPerWord);
+    for (int y = y0; y < y1; y++, row += wordsPerRow)
+    {
+        row[firstWord] = (row[firstWord] & ~head) | (pattern & head);
+        std::fill(row + firstWord + 1, row + lastWord, pattern);
+        row[lastWord] = (row[lastWord] & ~tail) | (pattern & tail);
+    }
+}
+
+std::vector<int> DungeonGenerationEngineBase::TileGrid::toVector() const
+{
+    std::vector<int> tiles((size_t)width * height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            tiles[(size_t)y * width + x] = get(x, y);
+    return tiles;
+}
+
+template <typename Coord>
+BasicDungeonGenerationEngine<Coord>::LineIndex::LineIndex(const LineSet& lines)
+{
+    assign(lines);
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::LineIndex::assign(const LineSet& lines)
+{
+    horizontal.clear();
+    vertical.clear();
+    for (const auto& line : lines)
+    {
+        double x1, y1, x2, y2;
+        std::tie(x1, y1, x2, y2) = line;
+        // Zero-length lines count as horizontal; the exact test covers both cases.
+        if (y1 == y2)
+            horizontal.push_back({ y1, std::min(x1, x2), std::max(x1, x2), line });
+        else if (x1 == x2)
+            vertical.push_back({ x1, std::min(y1, y2), std::max(y1, y2), line });
+    }
+    std::sort(horizontal.begin(), horizontal.end());
+    std::sort(vertical.begin(), vertical.end());
+}
+
+template <typename Coord>
+bool BasicDungeonGenerationEngine<Coord>::LineIndex::anyTouching(const std::vector<Segment>& segments, const RoomBox& box,
+    double fixedCentre, double fixedHalf, double spanCentre, double spanHalf)
+{
+    // Padded range and interval filters, then the exact RoomBox::isTouchingLine test.
+    constexpr double pad = 1e-6;
+    Segment first{ fixedCentre - fixedHalf - pad, 0.0, 0.0, {} };
+    double lastFixed = fixedCentre + fixedHalf + pad;
+    for (auto it = std::lower_bound(segments.begin(), segments.end(), first); it != segments.end() && it->fixed <= lastFixed; it++)
+    {
+        if (it->lo < spanCentre + spanHalf + pad && it->hi > spanCentre - spanHalf - pad && box.isTouchingLine(it->line))
+            return true;
+    }
+    return false;
+}
+
+template <typename Coord>
+bool BasicDungeonGenerationEngine<Coord>::LineIndex::isTouching(const RoomBox& box) const
+{
+    return anyTouching(horizontal, box, box.cy, box.h / 2.0, box.cx, box.w / 2.0)
+        || anyTouching(vertical, box, box.cx, box.w / 2.0, box.cy, box.h / 2.0);
+}
+
+template <typename Coord>
+constexpr bool BasicDungeonGenerationEngine<Coord>::RoomBoxComp::operator()(const RoomBox& lhs, const RoomBox& rhs) const
+{
+    return std::tie(lhs.cx, lhs.cy) < std::tie(rhs.cx, rhs.cy);
+}
+DungeonGenerationEngineBase::CentreHashSet::CentreHashSet(size_t expected)
+{
+    reset(expected);
+}
+
+void DungeonGenerationEngineBase::CentreHashSet::reset(size_t expected)
+{
+    size_t capacity = 16;
+    while (capacity < expected * 2)
+        capacity *= 2;
+    slots.assign(capacity, Slot());
+    count = 0;
+}
+
+namespace
+{
+    std::uint64_t centreBits(double v)
+    {
+        v += 0.0; // -0.0 and 0.0 compare equal, so they must hash equal too
+        std::uint64_t b;
+        std::memcpy(&b, &v, sizeof(b));
+        return b;
+    }
+
+    std::uint64_t centreHash(std::uint64_t x, std::uint64_t y)
+    {
+        std::uint64_t h = x * 0x9E3779B97F4A7C15ull ^ (y + 0x632BE59BD9B4E019ull + (x << 6) + (x >> 2));
+        h ^= h >> 31;
+        h *= 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 29;
+        return h;
+    }
+}
+
+bool DungeonGenerationEngineBase::CentreHashSet::insert(double cx, double cy)
+{
+    if ((count + 1) * 2 > slots.size())
+        grow();
+    if (!insertKey(centreBits(cx), centreBits(cy)))
+        return false;
+    count++;
+    return true;
+}
+
+bool DungeonGenerationEngineBase::CentreHashSet::insertKey(std::uint64_t x, std::uint64_t y)
+{
+    const size_t mask = slots.size() - 1;
+    for (size_t i = centreHash(x, y) & mask;; i = (i + 1) & mask)
+    {
+        auto& slot = slots[i];
+        if (!slot.used)
+        {
+            slot = { x, y, true };
+            return true;
+        }
+        if (slot.x == x && slot.y == y)
+            return false;
+    }
+}
+
+void DungeonGenerationEngineBase::CentreHashSet::grow()
+{
+    std::vector<Slot> old(std::max<size_t>(16, slots.size() * 2));
+    old.swap(slots);
+    for (const auto& slot : old)
+        if (slot.used)
+            insertKey(slot.x, slot.y);
+}
+
+
+namespace
+{
+    // Threads parallelFor uses for n items.
+    int numWorkers(int n, int numThreads)
+    {
+        if (numThreads <= 0)
+            numThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+        return std::max(1, std::min(numThreads, n));
+    }
+
+    // Runs fn(i, worker) for i = 0 .. n - 1 on numWorkers(n, numThreads) threads,
+    // worker being the index of the running thread (for per-thread scratch).
+    // Items are claimed dynamically, so results must not depend on the worker.
+    // If fn throws, the remaining items are skipped and the first exception is
+    // rethrown once every thread has stopped.
+    template <typename Fn>
+    void parallelFor(int n, int numThreads, Fn&& fn)
+    {
+        numThreads = numWorkers(n, numThreads);
+        if (numThreads <= 1)
+        {
+            for (int i = 0; i < n; i++)
+                fn(i, 0);
+            return;
+        }
+
+        std::atomic<int> next{ 0 };
+        std::exception_ptr error;
+        std::mutex errorLock;
+        auto worker = [&](int w)
+        {
+            try
+            {
+                for (int i = next++; i < n; i = next++)
+                    fn(i, w);
+            }
+            catch (...)
+            {
+                const std::lock_guard<std::mutex> lock(errorLock);
+                if (error == nullptr)
+                    error = std::current_exception();
+                next = n;
+            }
+        };
+        std::vector<std::thread> threads;
+        threads.reserve(numThreads - 1);
+        for (int t = 1; t < numThreads; t++)
+            threads.emplace_back(worker, t);
+        worker(0);
+        for (auto& t : threads)
+            t.join();
+        if (error != nullptr)
+            std::rethrow_exception(error);
+    }
+}
+
+template <typename Coord>
+typename BasicDungeonGenerationEngine<Coord>::RoomBoxVec BasicDungeonGenerationEngine<Coord>::randBox(
+    unsigned int seed, bool useRectRegion, float radiusX, float radiusY,
+    unsigned int numBox, unsigned int maxIteration, float smallBoxProb,
+    bool smallBoxUseNormalDist, float smallBoxDistParamA, float smallBoxDistParamB, float smallBoxRatioLimit,
+    bool largeBoxUseNormalDist, float largeBoxDistParamA, float largeBoxDistParamB, float largeBoxRatioLimit,
+    float largeBoxRadiusMultiplier)
+{
+    smallBoxDistParamA = std::max(0.0f, smallBoxDistParamA);
+    smallBoxDistParamB = std::max(0.0f, smallBoxDistParamB);
+    largeBoxDistParamA = std::max(0.0f, largeBoxDistParamA);
+    largeBoxDistParamB = std::max(0.0f, largeBoxDistParamB);
+    
+    if (!smallBoxUseNormalDist && smallBoxDistParamB < smallBoxDistParamA)
+        return {};
+    if (!largeBoxUseNormalDist && largeBoxDistParamB < largeBoxDistParamA)
+        return {};
+
+    radiusX = std::max(1.0f, radiusX);
+    radiusY = std::max(1.0f, radiusY);
+    largeBoxRadiusMultiplier = std::max(0.01f, largeBoxRadiusMultiplier);
+
+    GenerationWorkspace fallback;
+    auto& ws = workspace != nullptr ? *workspace : fallback;
+
+    // Candidate i is drawn from its own counter-based stream, so it depends only
+    // on (seed, i). Candidates are generated in parallel batches and then
+    // accepted strictly in index order, which keeps the result independent of
+    // the batch size and thread count.
+    using Candidate = typename GenerationWorkspace::BoxCandidate;
+    auto makeCandidate = [&](std::uint64_t index)
+    {
+        RandomStream random(seed, RandomStreamId::randBox, index);
+        Candidate c{ 0.0, 0.0, 0.0f, 0.0f, false };
+        bool largeBox = random.nextFloat() >= smallBoxProb;
+        bool useNormalDist = largeBox ? largeBoxUseNormalDist : smallBoxUseNormalDist;
+        float paramA = largeBox ? largeBoxDistParamA : smallBoxDistParamA;
+        float paramB = largeBox ? largeBoxDistParamB : smallBoxDistParamB;
+        float ratioLimit = largeBox ? largeBoxRatioLimit : smallBoxRatioLimit;
+        if (useNormalDist)
+        {
+            auto wh = random.nextNormalPair(paramA, paramB);
+            c.w = wh.first;
+            c.h = wh.second;
+        }
+        else
+        {
+            c.w = (float)random.nextInt((int)paramA, (int)paramB);
+            c.h = (float)random.nextInt((int)paramA, (int)paramB);
+        }
+        c.w = std::max(1.f, roundf(c.w));
+        c.h = std::max(1.f, roundf(c.h));
+        if (c.w / c.h > ratioLimit || c.h / c.w > ratioLimit)
+        {
+            c.rejected = true;
+            return c;
+        }
+
+        if (useRectRegion)
+        {
+            c.cx = (random.nextFloat() - 0.5) * 2.0 * radiusX;
+            c.cy = (random.nextFloat() - 0.5) * 2.0 * radiusY;
+        }
+        else
+        {
+            auto sc = portableSinCos2Pi(random.nextFloat());
+            double u = std::sqrt((double)random.nextFloat());
+            if (largeBox)
+                u *= largeBoxRadiusMultiplier;
+            c.cx = radiusX * u * sc.second;
+            c.cy = radiusY * u * sc.first;
+        }
+        return c;
+    };
+
+    // maxIteration caps accepted boxes. Candidates are capped separately, at a
+    // fixed number per box wanted, so impossible settings cannot loop forever.
+    constexpr std::uint64_t attemptsPerBox = 100;
+    const unsigned int target = std::min(numBox, maxIteration);
+    const std::uint64_t maxAttempts = (std::uint64_t)target * attemptsPerBox;
+    constexpr int chunk = 1024;
+
+    RoomBoxVec boxes = ws.takeBoxes();
+    boxes.reserve(target);
+    auto& centres = ws.centres;
+    centres.reset(target);
+    auto& batch = ws.candidates;
+    std::uint64_t attempts = 0, rejectedRatio = 0, rejectedDuplicate = 0;
+    while (boxes.size() < target && attempts < maxAttempts && !isCancelled())
+    {
+        // Draw a little more than is still missing, to cover rejections.
+        std::uint64_t missing = target - boxes.size();
+        auto batchSize = (int)std::min<std::uint64_t>(maxAttempts - attempts, std::min<std::uint64_t>(missing + missing / 4 + 64, 1 << 16));
+        batch.resize(batchSize);
+        const std::uint64_t first = attempts;
+        parallelFor((batchSize + chunk - 1) / chunk, batchSize >= 4 * chunk ? numThreads : 1, [&](int c, int)
+        {
+            int end = std::min(batchSize, (c + 1) * chunk);
+            for (int k = c * chunk; k < end; k++)
+                batch[k] = makeCandidate(first + k);
+        });
+
+        for (const auto& c : batch)
+        {
+            if (boxes.size() == target)
+                break;
+            attempts++;
+            if (c.rejected)
+                rejectedRatio++;
+            else if (centres.insert(c.cx, c.cy))
+                boxes.emplace_back(c.cx, c.cy, (int)c.w, (int)c.h);
+            else
+                rejectedDuplicate++;
+        }
+    }
+    if (stats != nullptr)
+    {
+        stats->candidates += attempts;
+        stats->rejectedRatio += rejectedRatio;
+        stats->rejectedDuplicate += rejectedDuplicate;
+    }
+
+    // Same order as before: unique centres in (cx, cy) order, then sorted by
+    // distance. Keys are computed once instead of a sqrt per comparison; the
+    // comparisons are identical so std::sort yields the same permutation.
+    std::sort(boxes.begin(), boxes.end(), RoomBoxComp());
+    auto& keyed = ws.keyedBoxes;
+    keyed.clear();
+    keyed.reserve(boxes.size());
+    for (const auto& box : boxes)
+        keyed.emplace_back(box.getDistance(), box);
+    using Keyed = std::pair<typename RoomBox::Distance, RoomBox>;
+    std::sort(keyed.begin(), keyed.end(), [](const Keyed& a, const Keyed& b) { return a.first < b.first; });
+    for (size_t k = 0; k < keyed.size(); k++)
+        boxes[k] = keyed[k].second;
+    if (!boxes.empty())
+        boxes[0].snapToGrid();
+
+    return boxes;
+}
+
+template <typename Coord>
+typename BasicDungeonGenerationEngine<Coord>::RoomBoxVec BasicDungeonGenerationEngine<Coord>::separateBox(RoomBoxVec boxes)
+{
+    GenerationWorkspace fallback;
+    auto& ws = workspace != nullptr ? *workspace : fallback;
+    ws.boxesSoA.assign(boxes);
+    separateBoxInPlace(ws.boxesSoA, ws);
+    ws.boxesSoA.copyTo(boxes);
+    return boxes;
+}
+
+template <typename Coord>
+typename BasicDungeonGenerationEngine<Coord>::RoomBoxSoA BasicDungeonGenerationEngine<Coord>::separateBox(RoomBoxSoA boxes)
+{
+    GenerationWorkspace fallback;
+    separateBoxInPlace(boxes, workspace != nullptr ? *workspace : fallback);
+    return boxes;
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::separateBoxInPlace(RoomBoxSoA& boxes, GenerationWorkspace& ws)
+{
+    // Each box is pushed away from every earlier box it overlaps, in index order,
+    // re-testing from its new position. Small sets scan the earlier boxes with the
+    // SIMD kernel; larger ones use the grid to narrow down which earlier boxes can
+    // overlap and pick the lowest such index above the last one moved away from.
+    // Both reproduce the plain fidx = 0..current-1 scan exactly.
+    constexpr int maxLinearScan = 512;
+    const int numBoxes = (int)boxes.size();
+    const bool useGrid = numBoxes > maxLinearScan;
+
+    auto& grid = ws.grid;
+    if (useGrid)
+    {
+        grid.reset(BoxGrid::suggestCellSize(boxes));
+        for (int i = 0; i < numBoxes; i++)
+            grid.insert(i, boxes.get(i));
+    }
+
+    auto& candidates = ws.gridHits;
+    std::uint64_t overlapTests = 0, moveAwayCalls = 0;
+    int rounds = 0;
+    auto publishStats = [&]()
+    {
+        if (stats == nullptr)
+            return;
+        stats->overlapTests += overlapTests;
+        stats->moveAwayCalls += moveAwayCalls;
+        stats->separationRounds += rounds;
+    };
+
+    bool overlapped = true;
+    for (int round = 0; round < 10 && overlapped; round++)
+    {
+        overlapped = false;
+        rounds++;
+        for (int current = 1; current < numBoxes; current++)
+        {
+            if (isCancelled())
+            {
+                publishStats();
+                return;
+            }
+            RoomBox box = boxes.get(current);
+            double dirx, diry;
+            std::tie(dirx, diry) = box.getOutwardDirection();
+
+            int fidx = -1;
+            while (true)
+            {
+                int next = current;
+                if (useGrid)
+                {
+                    candidates.clear();
+                    grid.query(box, candidates);
+                    for (int c : candidates)
+                    {
+                        if (c > fidx && c < next)
+                        {
+                            overlapTests++;
+                            if (box.isOverlap(boxes.get(c)))
+                                next = c;
+                        }
+                    }
+                }
+                else
+                {
+                    next = (int)boxes.findFirstOverlap(box, fidx + 1, current);
+                    overlapTests += (next == current) ? current - fidx - 1 : next - fidx;
+                }
+                if (next == current)
+                    break;
+
+                fidx = next;
+                overlapped = true;
+                moveAwayCalls++;
+                if (useGrid)
+                    grid.remove(current, box);
+                box.moveAwayFrom(boxes.get(fidx), dirx, diry);
+                boxes.set(current, box);
+                if (useGrid)
+                    grid.insert(current, box);
+            }
+        }
+    }
+    publishStats();
+
+    // Boxes still overlapping an earlier one after the last round; only counted
+    // when someone is looking, since it is another pass over all boxes.
+    if (stats != nullptr && overlapped)
+    {
+        for (int current = 1; current < numBoxes; current++)
+        {
+            RoomBox box = boxes.get(current);
+            bool overlaps;
+            if (useGrid)
+            {
+                candidates.clear();
+                grid.query(box, candidates);
+                overlaps = std::any_of(candidates.begin(), candidates.end(),
+                    [&](int c) { return c < current && box.isOverlap(boxes.get(c)); });
+            }
+            else
+            {
+                overlaps = boxes.findFirstOverlap(box, 0, current) != (size_t)current;
+            }
+            if (overlaps)
+                stats->residualOverlaps++;
+        }
+    }
+}
+
+namespace
+{
+    // Cell of the separation grid holding coordinate v.
+    template <typename Coord>
+    int separationCell(Coord v, double cellSize)
+    {
+        return (int)std::floor(v / cellSize);
+    }
+
+    int separationCell(FixedCoord v, double cellSize)
+    {
+        return (int)floorDiv(v.raw, (std::int64_t)cellSize * FixedCoord::one);
+    }
+}
+
+template <typename Coord>
+typename BasicDungeonGenerationEngine<Coord>::RoomBoxVec BasicDungeonGenerationEngine<Coord>::separateBoxParallel(RoomBoxVec boxes, int maxRounds)
+{
+    const int numBoxes = (int)boxes.size();
+    if (numBoxes < 2)
+        return boxes;
+
+    // Two boxes can only overlap if their centres are less than the larger box
+    // dimension apart on each axis, so with cells at least that big every box a
+    // box overlaps at the start of a phase has its centre in the 3x3 cells
+    // around it.
+    double cellSize = 1.0;
+    for (const auto& box : boxes)
+        cellSize = std::max(cellSize, (double)std::max(box.w, box.h));
+
+    auto cellCoord = [cellSize](Coord v) { return separationCell(v, cellSize); };
+    auto cellKey = [](int x, int y) { return ((long long)x << 32) ^ (long long)(unsigned int)y; };
+
+    GenerationWorkspace fallback;
+    auto& ws = workspace != nullptr ? *workspace : fallback;
+    auto& owners = ws.cellOwners;
+    auto& order = ws.cellOrder;
+    auto& cells = ws.cells;
+    auto& cellKeys = ws.cellKeys;
+    auto& phaseCells = ws.phaseCells;
+    auto& dirs = ws.directions;
+    owners.resize(numBoxes);
+    order.resize(numBoxes);
+    dirs.resize(numBoxes);
+
+    std::atomic<std::uint64_t> overlapTests{ 0 }, moveAwayCalls{ 0 };
+    int rounds = 0;
+    bool moved = true;
+    for (int round = 0; round < maxRounds && moved && !isCancelled(); round++)
+    {
+        moved = false;
+        rounds++;
+
+        // Directions are taken from where each box starts the round, as in separateBox.
+        for (int i = 0; i < numBoxes; i++)
+            dirs[i] = boxes[i].getOutwardDirection();
+
+        for (int phase = 0; phase < 4; phase++)
+        {
+            // Rebuild ownership from the current positions: boxes sorted by cell,
+            // ascending index within a cell.
+            for (int i = 0; i < numBoxes; i++)
+                owners[i] = { cellKey(cellCoord(boxes[i].cx), cellCoord(boxes[i].cy)), i };
+            std::sort(owners.begin(), owners.end());
+            // cellKeys is sorted along with cells, so a cell is found by binary search.
+            cells.clear();
+            cellKeys.clear();
+            for (int k = 0; k < numBoxes; k++)
+            {
+                int i = owners[k].second;
+                order[k] = i;
+                if (k == 0 || owners[k].first != owners[k - 1].first)
+                {
+                    cellKeys.push_back(owners[k].first);
+                    cells.push_back({ cellCoord(boxes[i].cx), cellCoord(boxes[i].cy), k, k });
+                }
+                cells.back().end = k + 1;
+            }
+
+            phaseCells.clear();
+            for (int c = 0; c < (int)cells.size(); c++)
+                if (((cells[c].x & 1) | ((cells[c].y & 1) << 1)) == phase)
+                    phaseCells.push_back(c);
+
+            std::atomic<bool> phaseMoved{ false };
+            const int numItems = (int)phaseCells.size();
+            if ((int)ws.workerCandidates.size() < numWorkers(numItems, numThreads))
+                ws.workerCandidates.resize(numWorkers(numItems, numThreads));
+            parallelFor(numItems, numThreads, [&](int item, int worker)
+            {
+                const auto& cell = cells[phaseCells[item]];
+                auto& candidates = ws.workerCandidates[worker];
+                candidates.clear();
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        auto key = cellKey(cell.x + dx, cell.y + dy);
+                        auto it = std::lower_bound(cellKeys.begin(), cellKeys.end(), key);
+                        if (it != cellKeys.end() && *it == key)
+                        {
+                            const auto& other = cells[it - cellKeys.begin()];
+                            candidates.insert(candidates.end(), order.begin() + other.begin, order.begin() + other.end);
+                        }
+                    }
+                }
+                std::sort(candidates.begin(), candidates.end());
+
+                std::uint64_t tests = 0, moves = 0;
+                for (int k = cell.begin; k < cell.end; k++)
+                {
+                    int current = order[k];
+                    RoomBox box = boxes[current];
+                    int fidx = -1;
+                    auto pos = candidates.begin();
+                    while (true)
+                    {
+                        // Lowest-indexed overlapping box above the last one moved away from.
+                        int next = current;
+                        for (; pos != candidates.end() && *pos < current; ++pos)
+                        {
+                            tests++;
+                            if (box.isOverlap(boxes[*pos]))
+                            {
+                                next = *pos++;
+                                break;
+                            }
+                        }
+                        if (next == current)
+                            break;
+                        fidx = next;
+                        moves++;
+                        box.moveAwayFrom(boxes[fidx], dirs[current].first, dirs[current].second);
+                    }
+                    boxes[current] = box;
+                }
+                overlapTests += tests;
+                moveAwayCalls += moves;
+                if (moves > 0)
+                    phaseMoved = true;
+            });
+            moved = moved || phaseMoved;
+        }
+    }
+
+    if (stats != nullptr)
+    {
+        stats->overlapTests += overlapTests;
+        stats->moveAwayCalls += moveAwayCalls;
+        stats->separationRounds += rounds;
+    }
+    return boxes;
+}
+
+namespace
+{
+    // Mean of the box centres, rounded to whole tiles.
+    template <typename RoomBox>
+    std::pair<double, double> roundedMeanCentre(const std::vector<RoomBox>& boxes)
+    {
+        double centerX = 0.0, centerY = 0.0;
+        for (auto& box : boxes)
+        {
+            centerX += box.cx;
+            centerY += box.cy;
+        }
+        centerX /= boxes.size();
+        centerY /= boxes.size();
+        return { std::round(centerX), std::round(centerY) };
+    }
+
+    std::pair<double, double> roundedMeanCentre(const std::vector<FixedRoomBox>& boxes)
+    {
+        std::int64_t sumX = 0, sumY = 0;
+        for (auto& box : boxes)
+        {
+            sumX += box.cx.raw;
+            sumY += box.cy.raw;
+        }
+        const std::int64_t n = (std::int64_t)boxes.size() * FixedCoord::one;
+        return { (double)roundDiv(sumX, n), (double)roundDiv(sumY, n) };
+    }
+
+    // Whether box lies within a map of half-extent halfWidth x halfHeight around the origin.
+    template <typename RoomBox>
+    bool isInsideMap(const RoomBox& box, int halfWidth, int halfHeight)
+    {
+        return !(box.x < -halfWidth || box.y < -halfHeight || box.x + box.w > halfWidth || box.y + box.h > halfHeight);
+    }
+
+    bool isInsideMap(const FixedRoomBox& box, int halfWidth, int halfHeight)
+    {
+        const std::int64_t halfW = (std::int64_t)halfWidth * FixedCoord::one;
+        const std::int64_t halfH = (std::int64_t)halfHeight * FixedCoord::one;
+        return !(box.x.raw < -halfW || box.y.raw < -halfH
+            || (std::int64_t)box.x.raw + box.w.raw > halfW || (std::int64_t)box.y.raw + box.h.raw > halfH);
+    }
+}
+
+template <typename Coord>
+typename BasicDungeonGenerationEngine<Coord>::RoomBoxVec BasicDungeonGenerationEngine<Coord>::centerAndCropBox(RoomBoxVec boxes, unsigned int mapWidth, unsigned int mapHeight)
+{
+    if (boxes.size() == 0)
+        return boxes;
+    
+    double centerX, centerY;
+    std::tie(centerX, centerY) = roundedMeanCentre(boxes);
+
+    // Kept boxes are compacted to the front in their original order.
+    const int halfWidth = (int)mapWidth / 2;
+    const int halfHeight = (int)mapHeight / 2;
+    size_t kept = 0;
+    for (auto& box : boxes)
+    {
+        box.moveDelta(-centerX, -centerY);
+        if (!isInsideMap(box, halfWidth, halfHeight))
+            continue;
+        boxes[kept++] = box;
+    }
+    boxes.erase(boxes.begin() + kept, boxes.end());
+    return boxes;
+}
+
+template <typename Coord>
+std::pair<typename BasicDungeonGenerationEngine<Coord>::RoomBoxVec, typename BasicDungeonGenerationEngine<Coord>::RoomBoxVec> BasicDungeonGenerationEngine<Coord>::randSelect(RoomBoxVec boxes, unsigned int numRooms, bool allowTouching)
+{
+    size_t split = randSelectInPlace(boxes, numRooms, allowTouching);
+    return splitBoxes(std::move(boxes), split);
+}
+
+template <typename Coord>
+size_t BasicDungeonGenerationEngine<Coord>::randSelectInPlace(RoomBoxVec& boxes, unsigned int numRooms, bool allowTouching)
+{
+    std::sort(boxes.begin(), boxes.end(), [](const RoomBox& a, const RoomBox& b) { return a.getSize() > b.getSize(); });
+
+    // Boxes left behind are compacted forward as the scan goes; the picked rooms
+    // are held in roomsSoA (which the touching test needs anyway) and written
+    // after them. Once enough rooms are picked the rest are already in place.
+    GenerationWorkspace fallback;
+    auto& ws = workspace != nullptr ? *workspace : fallback;
+    auto& roomsSoA = ws.roomsSoA;
+    roomsSoA.clear();
+
+    // The first rooms are checked with the SIMD scan. Past maxLinearScan they
+    // also go into the grid, and a candidate is only tested against the rooms
+    // sharing a cell with it, which the grid's padding guarantees includes
+    // every room it touches.
+    constexpr size_t maxLinearScan = 64;
+    auto& grid = ws.grid;
+    auto& hits = ws.gridHits;
+    bool useGrid = false;
+
+    size_t kept = 0, i = 0;
+    for (; i < boxes.size() && numRooms > 0; i++)
+    {
+        const RoomBox& box = boxes[i];
+        bool touching = false;
+        if (!allowTouching)
+        {
+            if (!useGrid && roomsSoA.size() >= maxLinearScan)
+            {
+                useGrid = true;
+                grid.reset(BoxGrid::suggestCellSize(boxes));
+                for (size_t k = 0; k < roomsSoA.size(); k++)
+                    grid.insert((int)k, roomsSoA.get(k));
+            }
+            if (useGrid)
+            {
+                hits.clear();
+                grid.query(box, hits);
+                touching = std::any_of(hits.begin(), hits.end(), [&](int k) { return box.isTouching(roomsSoA.get(k)); });
+            }
+            else
+            {
+                touching = roomsSoA.findFirstTouching(box, 0, roomsSoA.size()) != roomsSoA.size();
+            }
+        }
+        if (!touching)
+        {
+            if (useGrid)
+                grid.insert((int)roomsSoA.size(), box);
+            roomsSoA.push_back(box);
+            numRooms--;
+        }
+        else
+            boxes[kept++] = box;
+    }
+    std::move(boxes.begin() + i, boxes.end(), boxes.begin() + kept);
+    size_t split = boxes.size() - roomsSoA.size();
+    for (size_t k = 0; k < roomsSoA.size(); k++)
+        boxes[split + k] = roomsSoA.get(k);
+    return split;
+}
+
+template <typename Coord>
+std::pair<typename BasicDungeonGenerationEngine<Coord>::RoomBoxVec, typename BasicDungeonGenerationEngine<Coord>::RoomBoxVec> BasicDungeonGenerationEngine<Coord>::splitBoxes(RoomBoxVec boxes, size_t split)
+{
+    GenerationWorkspace fallback;
+    RoomBoxVec picked = (workspace != nullptr ? *workspace : fallback).takeBoxes();
+    picked.assign(boxes.begin() + split, boxes.end());
+    boxes.erase(boxes.begin() + split, boxes.end());
+    return std::make_pair(std::move(boxes), std::move(picked));
+}
+
+template <typename Coord>
+DungeonGenerationEngineBase::EdgeGraph BasicDungeonGenerationEngine<Coord>::triangulate(const RoomBoxVec& rooms)
+{
+    WorkspaceBase fallback;
+    auto& ws = workspace != nullptr ? *workspace : fallback;
+    auto& coords = ws.coords;
+    coords.clear();
+    coords.reserve(rooms.size() * 2);
+    for (const auto& room : rooms)
+    {
+        coords.push_back(room.cx);
+        coords.push_back(room.cy);
+    }
+
+    EdgeGraph graph = triangulateCentres(ws);
+    graph.weights.reserve(graph.neighbours.size());
+    for (int u = 0; u < graph.getNumNodes(); u++)
+        for (int k = graph.offsets[u]; k < graph.offsets[u + 1]; k++)
+            graph.weights.push_back(rooms[u].getHamiltonDist(rooms[graph.neighbours[k]]));
+    return graph;
+}
 
-    std::default_random_engine generator(seed);
-    std::uniform_real_distribution<float> choice_dist(0.0f, 1.0f);
+DungeonGenerationEngineBase::EdgeGraph DungeonGenerationEngineBase::triangulateCentres(WorkspaceBase& ws)
+{
+    const size_t numRooms = ws.coords.size() / 2;
+    auto& arcs = ws.arcs;
+    arcs.clear();
+    if (numRooms == 2)
+    {
+        arcs.push_back({ 0, 1 });
+        arcs.push_back({ 1, 0 });
+    }
+    else if (numRooms > 2)
+    {
+        // Each undirected edge is either a hull edge (no opposite halfedge) or the
+        // lower-indexed one of a halfedge pair, so this visits it exactly once.
+        auto& d = ws.triangulator;
+        d.update(ws.coords);
+        if (stats != nullptr)
+            stats->triangles += d.triangles.size() / 3;
+        arcs.reserve(std::max(d.triangles.size(), 2 * numRooms));
+        // All centres on one line: no triangles, and the hull is the chain of
+        // rooms along the line.
+        if (d.triangles.empty())
+            for (std::size_t e = d.hull_start; d.hull_next[e] != d.hull_start; e = d.hull_next[e])
+            {
+                arcs.push_back({ (int)e, (int)d.hull_next[e] });
+                arcs.push_back({ (int)d.hull_next[e], (int)e });
+            }
+        for (std::size_t e = 0; e < d.triangles.size(); e++)
+        {
+            std::size_t opposite = d.halfedges[e];
+            if (opposite != delaunator::INVALID_INDEX && opposite < e)
+                continue;
+            std::size_t next = (e % 3 == 2) ? e - 2 : e + 1;
+            int a = (int)d.triangles[e];
+            int b = (int)d.triangles[next];
+            arcs.push_back({ a, b });
+            arcs.push_back({ b, a });
+        }
+    }
+    std::sort(arcs.begin(), arcs.end());
+
+    EdgeGraph graph = ws.takeGraph();
+    graph.offsets.assign(numRooms + 1, 0);
+    graph.neighbours.reserve(arcs.size());
+    for (const auto& arc : arcs)
+    {
+        graph.offsets[arc.first + 1]++;
+        graph.neighbours.push_back(arc.second);
+    }
+    for (size_t i = 1; i < graph.offsets.size(); i++)
+        graph.offsets[i] += graph.offsets[i - 1];
+    return graph;
+}
+
+DungeonGenerationEngineBase::EdgeSet DungeonGenerationEngineBase::mst(const EdgeGraph& edges, WorkspaceBase* workspace)
+{
+    using iPair = std::pair<int, double>;
+
+    if (edges.empty())
+        return {};
+
+    WorkspaceBase fallback;
+    auto& ws = workspace != nullptr ? *workspace : fallback;
+
+    unsigned int numRooms = edges.getNumNodes();
+    EdgeSet mst_edges;
+
+    // Min-heap with the same operations as std::priority_queue, over reused storage.
+    auto& pq = ws.heap;
+    auto pqPush = [&pq](const iPair& item)
+    {
+        pq.push_back(item);
+        std::push_heap(pq.begin(), pq.end(), std::greater<iPair>());
+    };
+    int src = 0;
+    auto& key = ws.key;
+    auto& parent = ws.parent;
+    auto& inMst = ws.inMst;
+    pq.clear();
+    key.assign(numRooms, std::numeric_limits<double>::max());
+    parent.assign(numRooms, -1);
+    inMst.assign(numRooms, false);
+
+    pqPush({ 0.0, src });
+    key[src] = 0.0;
+    while (!pq.empty())
+    {
+        int u = pq.front().second;
+        std::pop_heap(pq.begin(), pq.end(), std::greater<iPair>());
+        pq.pop_back();
+        if (inMst[u] == true) {
+            continue;
+        }
+        inMst[u] = true;
+
+        for (int k = edges.offsets[u]; k < edges.offsets[u + 1]; k++)
+        {
+            int v = edges.neighbours[k];
+            int weight = edges.weights[k];
+
+            if (inMst[v] == false && key[v] > weight)
+            {
+                key[v] = weight;
+                pqPush({ key[v], v });
+                parent[v] = u;
+            }
+        }
+    }
+    for (int i = 1; i < numRooms; i++)
+        if (parent[i] != -1)
+            ws.insert(mst_edges, { i, parent[i] });
+    return mst_edges;
+}
+
+DungeonGenerationEngineBase::EdgeSet DungeonGenerationEngineBase::addSomeEdgesBack(
+    unsigned int seed,
+    const EdgeGraph& edges,
+    EdgeSet mst_edges,
+    float addBackProb,
+    WorkspaceBase* workspace)
+{
+    WorkspaceBase fallback;
+    auto& ws = workspace != nullptr ? *workspace : fallback;
+
+    // One draw per CSR entry, indexed by its position, so each edge's decision
+    // is independent of the others.
+    for (int na = 0; na < edges.getNumNodes(); na++)
+    {
+        for (int k = edges.offsets[na]; k < edges.offsets[na + 1]; k++)
+        {
+            int nb = edges.neighbours[k];
+            if (mst_edges.find({ na, nb }) == mst_edges.end()
+                && mst_edges.find({ nb, na }) == mst_edges.end()
+                && RandomStream(seed, RandomStreamId::addSomeEdgesBack, (std::uint64_t)k).nextFloat() < addBackProb)
+            {
+                ws.insert(mst_edges, { na, nb });
+            }
+        }
+    }
+    return mst_edges;
+}
+
+namespace
+{
+    // Whether boxes a and b, given along one axis by position, centre and size,
+    // overlap there by at least padding, so one straight line joins them; if so
+    // middle is the middle of the span they share.
+    template <typename Coord>
+    bool findSharedSpan(Coord aPos, Coord aCentre, Coord aSize, Coord bPos, Coord bCentre, Coord bSize,
+        unsigned int padding, double& middle)
+    {
+        if (!(std::abs(aCentre - bCentre) <= aSize / 2.0 + bSize / 2.0 - padding))
+            return false;
+        middle = (std::max(aPos, bPos) + std::min(aPos + aSize, bPos + bSize)) / 2;
+        return true;
+    }
+
+    bool findSharedSpan(FixedCoord aPos, FixedCoord aCentre, FixedCoord aSize, FixedCoord bPos, FixedCoord bCentre, FixedCoord bSize,
+        unsigned int padding, double& middle)
+    {
+        if (2 * absDiff(aCentre, bCentre) > (std::int64_t)aSize.raw + bSize.raw - 2 * (std::int64_t)padding * FixedCoord::one)
+            return false;
+        std::int64_t lo = std::max<std::int64_t>(aPos.raw, bPos.raw);
+        std::int64_t hi = std::min<std::int64_t>((std::int64_t)aPos.raw + aSize.raw, (std::int64_t)bPos.raw + bSize.raw);
+        middle = (double)(lo + hi) / (2 * FixedCoord::one);
+        return true;
+    }
+}
+
+template <typename Coord>
+DungeonGenerationEngineBase::LineSet BasicDungeonGenerationEngine<Coord>::lineConnect(
+    unsigned int seed,
+    const RoomBoxVec& rooms, const EdgeSet& mst_edges,
+    unsigned int overlapPadding, bool addBothDirection, float firstHorizontalProb)
+{
+    WorkspaceBase fallback;
+    auto& ws = workspace != nullptr ? *workspace : fallback;
+    LineSet lines;
 
+    std::uint64_t edgeIndex = 0;
     for (const auto& e : mst_edges)
     {
+        RandomStream random(seed, RandomStreamId::lineConnect, edgeIndex++);
         const RoomBox& a = rooms[e.first];
         const RoomBox& b = rooms[e.second];
-        if (abs(a.cx - b.cx) <= a.w / 2.0 + b.w / 2.0 - overlapPadding)
+        double centerx, centery;
+        if (findSharedSpan(a.x, a.cx, a.w, b.x, b.cx, b.w, overlapPadding, centerx))
         {
-            auto centerx = (std::max(a.x, b.x) + std::min(a.x + a.w, b.x + b.w)) / 2;
-            lines.insert({ centerx, a.cy, centerx, b.cy });
+            ws.insert(lines, { centerx, a.cy, centerx, b.cy });
         }
-        else if (abs(a.cy - b.cy) <= a.h / 2.0 + b.h / 2.0 - overlapPadding)
+        else if (findSharedSpan(a.y, a.cy, a.h, b.y, b.cy, b.h, overlapPadding, centery))
         {
-            auto centery = (std::max(a.y, b.y) + std::min(a.y + a.h, b.y + b.h)) / 2;
-            lines.insert({ a.cx, centery, b.cx, centery });
+            ws.insert(lines, { a.cx, centery, b.cx, centery });
         }
         else
         {
             if (addBothDirection)
             {
-                lines.insert({ a.cx, a.cy, b.cx, a.cy });
-                lines.insert({ b.cx, a.cy, b.cx, b.cy });
-                lines.insert({ a.cx, a.cy, a.cx, b.cy });
-                lines.insert({ a.cx, b.cy, b.cx, b.cy });
+                ws.insert(lines, { a.cx, a.cy, b.cx, a.cy });
+                ws.insert(lines, { b.cx, a.cy, b.cx, b.cy });
+                ws.insert(lines, { a.cx, a.cy, a.cx, b.cy });
+                ws.insert(lines, { a.cx, b.cy, b.cx, b.cy });
             }
             else
             {
-                if (choice_dist(generator) < firstHorizontalProb)
+                if (random.nextFloat() < firstHorizontalProb)
                 {
-                    lines.insert({ a.cx, a.cy, b.cx, a.cy });
-                    lines.insert({ b.cx, a.cy, b.cx, b.cy });
+                    ws.insert(lines, { a.cx, a.cy, b.cx, a.cy });
+                    ws.insert(lines, { b.cx, a.cy, b.cx, b.cy });
                 }
                 else
                 {
-                    lines.insert({ a.cx, a.cy, a.cx, b.cy });
-                    lines.insert({ a.cx, b.cy, b.cx, b.cy });
+                    ws.insert(lines, { a.cx, a.cy, a.cx, b.cy });
+                    ws.insert(lines, { a.cx, b.cy, b.cx, b.cy });
                 }
             }
         }
@@ -540,84 +2038,728 @@ DungeonGenerationEngine::LineSet DungeonGenerationEngine::lineConnect(
     return lines;
 }
 
-std::pair<DungeonGenerationEngine::RoomBoxVec, DungeonGenerationEngine::RoomBoxVec> DungeonGenerationEngine::selectCorridors(
+template <typename Coord>
+std::pair<typename BasicDungeonGenerationEngine<Coord>::RoomBoxVec, typename BasicDungeonGenerationEngine<Coord>::RoomBoxVec> BasicDungeonGenerationEngine<Coord>::selectCorridors(
     RoomBoxVec boxes, const LineSet& lines, unsigned int maxRoomSize)
 {
-    RoomBoxVec corridors;
-    auto it = boxes.begin();
-    while (it != boxes.end())
+    size_t split = selectCorridorsInPlace(boxes, lines, maxRoomSize);
+    return splitBoxes(std::move(boxes), split);
+}
+
+template <typename Coord>
+size_t BasicDungeonGenerationEngine<Coord>::selectCorridorsInPlace(RoomBoxVec& boxes, const LineSet& lines, unsigned int maxRoomSize)
+{
+    GenerationWorkspace fallback;
+    auto& ws = workspace != nullptr ? *workspace : fallback;
+    auto& index = ws.lineIndex;
+    index.assign(lines);
+
+    // Same two-part stable partition as randSelectInPlace, with the corridors
+    // staged in scratch storage.
+    auto& corridors = ws.pickedBoxes;
+    corridors.clear();
+    size_t kept = 0;
+    for (size_t i = 0; i < boxes.size(); i++)
     {
-        if (it->getSize() > maxRoomSize)
-        {
-            it++;
-            continue;
-        }
-        bool touching = false;
-        for (const auto& line : lines)
-        {
-            if (it->isTouchingLine(line))
-            {
-                touching = true;
-                break;
-            }
-        }
-        if (touching)
-        {
-            corridors.push_back(*it);
-            it = boxes.erase(it);
-        }
+        if (boxes[i].getSize() <= maxRoomSize && index.isTouching(boxes[i]))
+            corridors.push_back(boxes[i]);
         else
-            it++;
+            boxes[kept++] = boxes[i];
     }
-    return std::make_pair(boxes, corridors);
+    std::copy(corridors.begin(), corridors.end(), boxes.begin() + kept);
+    return kept;
 }
 
-std::vector<int> DungeonGenerationEngine::tiling(
-    const RoomBoxVec& rooms, const RoomBoxVec& corridors, const LineSet& lines,
-    unsigned int mapWidth, unsigned int mapHeight)
+namespace
 {
-    std::vector<int> tiles(mapWidth * mapHeight, 0);
-    int halfW = mapWidth / 2;
-    int halfH = mapHeight / 2;
+    // Cells [x0, x1) x [y0, y1) of the full map set to value by one primitive.
+    // Every primitive tiling() draws covers a rectangle: a horizontal line marks
+    // the one or two rows around it, a vertical line the one or two columns.
+    struct TileRect
+    {
+        int x0, y0, x1, y1;
+        int value;
+        bool empty() const { return x0 >= x1 || y0 >= y1; }
+    };
 
-    for (const auto& line : lines)
+    // Line tiles on the far edge of the map are dropped rather than written past
+    // the last row or column.
+    TileRect lineFootprint(const std::tuple<double, double, double, double>& line, int mapWidth, int mapHeight)
     {
         double x1, y1, x2, y2;
         std::tie(x1, y1, x2, y2) = line;
-        x1 += halfW;
-        x2 += halfW;
-        y1 += halfH;
-        y2 += halfH;
+        x1 += mapWidth / 2;
+        x2 += mapWidth / 2;
+        y1 += mapHeight / 2;
+        y2 += mapHeight / 2;
+        TileRect r{ 0, 0, 0, 0, 1 };
         if (y1 == y2)
         {
             if (x2 < x1)
                 std::swap(x1, x2);
-            for (int x = std::max(0.0, floor(x1 - 0.5)); x < std::min((double)mapWidth, ceil(x2 + 0.5)); x++)
-            {
-                tiles[(int)std::max(0.0, floor(y1 - 0.5)) * mapWidth + x] = 1;
-                tiles[(int)std::min((double)mapHeight, floor(y1 + 0.5)) * mapWidth + x] = 1;
-            }
+            r.x0 = (int)std::max(0.0, floor(x1 - 0.5));
+            r.x1 = (int)std::min((double)mapWidth, ceil(x2 + 0.5));
+            r.y0 = (int)std::max(0.0, floor(y1 - 0.5));
+            r.y1 = std::min(mapHeight, (int)std::min((double)mapHeight, floor(y1 + 0.5)) + 1);
         }
         else if (x1 == x2)
         {
             if (y2 < y1)
                 std::swap(y1, y2);
-            for (int y = std::max(0.0, floor(y1 - 0.5)); y < std::min((double)mapHeight, ceil(y2 + 0.5)); y++)
+            r.y0 = (int)std::max(0.0, floor(y1 - 0.5));
+            r.y1 = (int)std::min((double)mapHeight, ceil(y2 + 0.5));
+            r.x0 = (int)std::max(0.0, floor(x1 - 0.5));
+            r.x1 = std::min(mapWidth, (int)std::min((double)mapWidth, floor(x1 + 0.5)) + 1);
+        }
+        return r;
+    }
+
+    // Same cells as stepping int x and y from the box's top-left corner while
+    // they are below its far edges.
+    template <typename RoomBox>
+    TileRect boxFootprint(const RoomBox& box, int mapWidth, int mapHeight, int value)
+    {
+        double left = (double)box.x + mapWidth / 2;
+        double top = (double)box.y + mapHeight / 2;
+        return { (int)left, (int)top, (int)ceil(left + (double)box.w), (int)ceil(top + (double)box.h), value };
+    }
+
+    TileRect boxFootprint(const FixedRoomBox& box, int mapWidth, int mapHeight, int value)
+    {
+        std::int64_t left = box.x.raw + (std::int64_t)(mapWidth / 2) * FixedCoord::one;
+        std::int64_t top = box.y.raw + (std::int64_t)(mapHeight / 2) * FixedCoord::one;
+        return { (int)(left / FixedCoord::one), (int)(top / FixedCoord::one),
+            (int)ceilDiv(left + box.w.raw, FixedCoord::one), (int)ceilDiv(top + box.h.raw, FixedCoord::one), value };
+    }
+
+    // Paints r into tiles, which holds the map window starting at (originX, originY).
+    // Returns the number of tiles written.
+    std::uint64_t paintTileRect(DungeonGenerationEngineBase::TileGrid& tiles, int originX, int originY, const TileRect& r)
+    {
+        int x0 = std::max(r.x0 - originX, 0);
+        int x1 = std::min(r.x1 - originX, tiles.getWidth());
+        int y0 = std::max(r.y0 - originY, 0);
+        int y1 = std::min(r.y1 - originY, tiles.getHeight());
+        if (x0 >= x1 || y0 >= y1)
+            return 0;
+        tiles.fillRect(x0, y0, x1, y1, r.value);
+        return (std::uint64_t)(x1 - x0) * (std::uint64_t)(y1 - y0);
+    }
+
+    std::uint64_t paintLines(DungeonGenerationEngineBase::TileGrid& tiles, int originX, int originY,
+        const DungeonGenerationEngineBase::LineSet& lines, int mapWidth, int mapHeight)
+    {
+        std::uint64_t written = 0;
+        for (const auto& line : lines)
+            written += paintTileRect(tiles, originX, originY, lineFootprint(line, mapWidth, mapHeight));
+        return written;
+    }
+
+    // forEachChunk once the footprints are known: buckets them by chunk, in
+    // paint order, then paints and hands out one chunk at a time.
+    void forEachChunkOfFootprints(const DungeonGenerationEngineBase& engine, const std::vector<TileRect>& footprints,
+        int mapWidth, int mapHeight, int chunkSize,
+        const std::function<void(int x, int y, const DungeonGenerationEngineBase::TileGrid& chunk)>& callback)
+    {
+        int w = mapWidth;
+        int h = mapHeight;
+        int chunksX = (w + chunkSize - 1) / chunkSize;
+        int chunksY = (h + chunkSize - 1) / chunkSize;
+
+        std::vector<std::vector<int>> buckets((size_t)chunksX * chunksY);
+        for (int i = 0; i < (int)footprints.size(); i++)
+        {
+            const auto& r = footprints[i];
+            int cx0 = std::max(r.x0, 0) / chunkSize;
+            int cx1 = std::min(r.x1, w);
+            int cy0 = std::max(r.y0, 0) / chunkSize;
+            int cy1 = std::min(r.y1, h);
+            if (r.empty() || cx1 <= 0 || cy1 <= 0)
+                continue;
+            cx1 = (cx1 - 1) / chunkSize;
+            cy1 = (cy1 - 1) / chunkSize;
+            for (int cy = cy0; cy <= cy1; cy++)
+                for (int cx = cx0; cx <= cx1; cx++)
+                    buckets[(size_t)cy * chunksX + cx].push_back(i);
+        }
+
+        DungeonGenerationEngineBase::TileGrid chunk;
+        for (int cy = 0; cy < chunksY && !engine.isCancelled(); cy++)
+        {
+            for (int cx = 0; cx < chunksX; cx++)
             {
-                tiles[y * mapWidth + (int)std::max(0.0, floor(x1 - 0.5))] = 1;
-                tiles[y * mapWidth + (int)std::min((double)mapWidth, floor(x1 + 0.5))] = 1;
+                int x = cx * chunkSize;
+                int y = cy * chunkSize;
+                chunk.reset(std::min(chunkSize, w - x), std::min(chunkSize, h - y));
+                auto& bucket = buckets[(size_t)cy * chunksX + cx];
+                std::uint64_t written = 0;
+                for (int i : bucket)
+                    written += paintTileRect(chunk, x, y, footprints[i]);
+                if (engine.stats != nullptr)
+                    engine.stats->tilesWritten += written;
+                std::vector<int>().swap(bucket);
+                callback(x, y, chunk);
             }
         }
     }
+}
+
+template <typename Coord>
+DungeonGenerationEngineBase::TileGrid BasicDungeonGenerationEngine<Coord>::tiling(
+    const RoomBoxVec& rooms, const RoomBoxVec& corridors, const LineSet& lines,
+    unsigned int mapWidth, unsigned int mapHeight)
+{
+    return tilingChunk(rooms, corridors, lines, mapWidth, mapHeight, 0, 0, (int)mapWidth, (int)mapHeight);
+}
+
+template <typename Coord>
+DungeonGenerationEngineBase::TileGrid BasicDungeonGenerationEngine<Coord>::tilingChunk(
+    const RoomBoxVec& rooms, const RoomBoxVec& corridors, const LineSet& lines,
+    unsigned int mapWidth, unsigned int mapHeight,
+    int x, int y, int width, int height)
+{
+    WorkspaceBase fallback;
+    TileGrid tiles = (workspace != nullptr ? *workspace : fallback).takeTiles(width, height);
+    int w = (int)mapWidth;
+    int h = (int)mapHeight;
+
+    // Later writes win: lines, then corridors, then rooms.
+    std::uint64_t written = paintLines(tiles, x, y, lines, w, h);
+    for (const auto& box : corridors)
+        written += paintTileRect(tiles, x, y, boxFootprint(box, w, h, 2));
+    for (const auto& box : rooms)
+        written += paintTileRect(tiles, x, y, boxFootprint(box, w, h, 3));
+    if (stats != nullptr)
+        stats->tilesWritten += written;
+
+    return tiles;
+}
 
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::forEachChunk(
+    const RoomBoxVec& rooms, const RoomBoxVec& corridors, const LineSet& lines,
+    unsigned int mapWidth, unsigned int mapHeight, int chunkSize,
+    const std::function<void(int x, int y, const TileGrid& chunk)>& callback)
+{
+    jassert(chunkSize > 0);
+    int w = (int)mapWidth;
+    int h = (int)mapHeight;
+
+    // Footprints in paint order; each chunk keeps the ascending indices of the
+    // footprints that overlap it, which preserves the paint order per chunk.
+    std::vector<TileRect> footprints;
+    footprints.reserve(lines.size() + corridors.size() + rooms.size());
+    for (const auto& line : lines)
+        footprints.push_back(lineFootprint(line, w, h));
     for (const auto& box : corridors)
-        for (int y = box.y + halfH; y < box.y + box.h + halfH; y++)
-            for (int x = box.x + halfW; x < box.x + box.w + halfW; x++)
-                tiles[y * mapWidth + x] = 2;
+        footprints.push_back(boxFootprint(box, w, h, 2));
     for (const auto& box : rooms)
-        for (int y = box.y + halfH; y < box.y + box.h + halfH; y++)
-            for (int x = box.x + halfW; x < box.x + box.w + halfW; x++)
-                tiles[y * mapWidth + x] = 3;
+        footprints.push_back(boxFootprint(box, w, h, 3));
+
+    forEachChunkOfFootprints(*this, footprints, w, h, chunkSize, callback);
+}
+
+//==============================================================================
+#if DUNGEON_GEN_PMR
+DungeonGenerationEngineBase::WorkspaceBase::WorkspaceBase(std::pmr::memory_resource* resource)
+    : candidates(resource),
+    directions(resource), cellOwners(resource), cellOrder(resource), cellKeys(resource), cells(resource), phaseCells(resource),
+    arcs(resource),
+    heap(resource), key(resource), parent(resource), inMst(resource)
+{
+}
+
+template <typename Coord>
+BasicDungeonGenerationEngine<Coord>::GenerationWorkspace::GenerationWorkspace(std::pmr::memory_resource* resource)
+    : WorkspaceBase(resource), keyedBoxes(resource), pickedBoxes(resource)
+{
+}
+#endif
+
+namespace
+{
+    // Spare containers kept per kind; enough for every stage of one dungeon.
+    constexpr size_t maxSpares = 4;
+
+    template <typename T>
+    T takeSpare(std::vector<T>& spares)
+    {
+        if (spares.empty())
+            return T();
+        T item = std::move(spares.back());
+        spares.pop_back();
+        return item;
+    }
+
+    template <typename Set>
+    void insertRecycled(Set& set, std::vector<typename Set::node_type>& spareNodes, const typename Set::value_type& value)
+    {
+        if (spareNodes.empty())
+        {
+            set.insert(value);
+            return;
+        }
+        auto node = std::move(spareNodes.back());
+        spareNodes.pop_back();
+        node.value() = value;
+        auto result = set.insert(std::move(node));
+        if (!result.inserted)
+            spareNodes.push_back(std::move(result.node));
+    }
+
+    template <typename Set>
+    void recycleNodes(Set& set, std::vector<typename Set::node_type>& spareNodes)
+    {
+        while (!set.empty())
+            spareNodes.push_back(set.extract(set.begin()));
+    }
+}
+
+DungeonGenerationEngineBase::EdgeGraph DungeonGenerationEngineBase::WorkspaceBase::takeGraph()
+{
+    return takeSpare(spareGraphs);
+}
 
+DungeonGenerationEngineBase::TileGrid DungeonGenerationEngineBase::WorkspaceBase::takeTiles(int width, int height)
+{
+    TileGrid tiles = takeSpare(spareTiles);
+    tiles.reset(width, height);
     return tiles;
 }
+
+void DungeonGenerationEngineBase::WorkspaceBase::recycle(EdgeGraph&& graph)
+{
+    graph.offsets.clear();
+    graph.neighbours.clear();
+    graph.weights.clear();
+    if (graph.offsets.capacity() > 0 && spareGraphs.size() < maxSpares)
+        spareGraphs.push_back(std::move(graph));
+}
+
+void DungeonGenerationEngineBase::WorkspaceBase::recycle(TileGrid&& tiles)
+{
+    if (!tiles.empty() && spareTiles.size() < maxSpares)
+        spareTiles.push_back(std::move(tiles));
+}
+
+void DungeonGenerationEngineBase::WorkspaceBase::recycle(EdgeSet&& edges)
+{
+    recycleNodes(edges, spareEdgeNodes);
+}
+
+void DungeonGenerationEngineBase::WorkspaceBase::recycle(LineSet&& lines)
+{
+    recycleNodes(lines, spareLineNodes);
+}
+
+void DungeonGenerationEngineBase::WorkspaceBase::insert(EdgeSet& edges, const std::pair<int, int>& edge)
+{
+    insertRecycled(edges, spareEdgeNodes, edge);
+}
+
+void DungeonGenerationEngineBase::WorkspaceBase::insert(LineSet& lines, const std::tuple<double, double, double, double>& line)
+{
+    insertRecycled(lines, spareLineNodes, line);
+}
+
+template <typename Coord>
+typename BasicDungeonGenerationEngine<Coord>::RoomBoxVec BasicDungeonGenerationEngine<Coord>::GenerationWorkspace::takeBoxes()
+{
+    return takeSpare(spareBoxes);
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::GenerationWorkspace::recycle(RoomBoxVec&& boxes)
+{
+    boxes.clear();
+    if (boxes.capacity() > 0 && spareBoxes.size() < maxSpares)
+        spareBoxes.push_back(std::move(boxes));
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::GenerationWorkspace::recycle(Dungeon&& dungeon)
+{
+    recycle(std::move(dungeon.boxes));
+    recycle(std::move(dungeon.rooms));
+    recycle(std::move(dungeon.corridors));
+    recycle(std::move(dungeon.edges));
+    recycle(std::move(dungeon.mst_edges));
+    recycle(std::move(dungeon.lines));
+    recycle(std::move(dungeon.tiles));
+    dungeon.generated = false;
+}
+
+//==============================================================================
+DungeonGenerationEngineBase::Parameters DungeonGenerationEngineBase::Parameters::fromValueTree(const juce::ValueTree& state)
+{
+    Parameters p;
+    const auto& generalParams = state.getChildWithName(juce::Identifier("General"));
+    p.seed = (unsigned int)(int)generalParams.getProperty(juce::Identifier("seed"), (int)p.seed);
+    p.maxIteration = (unsigned int)(int)generalParams.getProperty(juce::Identifier("maxIteration"), (int)p.maxIteration);
+    p.mapWidth = (unsigned int)(int)generalParams.getProperty(juce::Identifier("mapWidth"), (int)p.mapWidth);
+    p.mapHeight = (unsigned int)(int)generalParams.getProperty(juce::Identifier("mapHeight"), (int)p.mapHeight);
+
+    const auto& boxGenParams = state.getChildWithName(juce::Identifier("Random Box Generation"));
+    p.useRectRegion = boxGenParams.getProperty(juce::Identifier("useRectRegion"), p.useRectRegion);
+    p.parallelSeparation = boxGenParams.getProperty(juce::Identifier("parallelSeparation"), p.parallelSeparation);
+    p.radiusX = boxGenParams.getProperty(juce::Identifier("radiusX"), p.radiusX);
+    p.radiusY = boxGenParams.getProperty(juce::Identifier("radiusY"), p.radiusY);
+    p.numBox = (unsigned int)(int)boxGenParams.getProperty(juce::Identifier("numBox"), (int)p.numBox);
+    p.smallBoxProb = boxGenParams.getProperty(juce::Identifier("smallBoxProb"), p.smallBoxProb);
+    p.smallBoxRatioLimit = boxGenParams.getProperty(juce::Identifier("smallBoxRatioLimit"), p.smallBoxRatioLimit);
+    p.largeBoxRatioLimit = boxGenParams.getProperty(juce::Identifier("largeBoxRatioLimit"), p.largeBoxRatioLimit);
+    p.largeBoxRadiusMul = boxGenParams.getProperty(juce::Identifier("largeBoxRadiusMul"), p.largeBoxRadiusMul);
+    p.smallBoxUseNormalDist = boxGenParams.getProperty(juce::Identifier("smallBoxUseNormalDist"), p.smallBoxUseNormalDist);
+    p.smallBoxDistUnifA = boxGenParams.getProperty(juce::Identifier("smallBoxDistUnifA"), p.smallBoxDistUnifA);
+    p.smallBoxDistUnifB = boxGenParams.getProperty(juce::Identifier("smallBoxDistUnifB"), p.smallBoxDistUnifB);
+    p.smallBoxDistMu = boxGenParams.getProperty(juce::Identifier("smallBoxDistMu"), p.smallBoxDistMu);
+    p.smallBoxDistSigma = boxGenParams.getProperty(juce::Identifier("smallBoxDistSigma"), p.smallBoxDistSigma);
+    p.largeBoxUseNormalDist = boxGenParams.getProperty(juce::Identifier("largeBoxUseNormalDist"), p.largeBoxUseNormalDist);
+    p.largeBoxDistUnifA = boxGenParams.getProperty(juce::Identifier("largeBoxDistUnifA"), p.largeBoxDistUnifA);
+    p.largeBoxDistUnifB = boxGenParams.getProperty(juce::Identifier("largeBoxDistUnifB"), p.largeBoxDistUnifB);
+    p.largeBoxDistMu = boxGenParams.getProperty(juce::Identifier("largeBoxDistMu"), p.largeBoxDistMu);
+    p.largeBoxDistSigma = boxGenParams.getProperty(juce::Identifier("largeBoxDistSigma"), p.largeBoxDistSigma);
+
+    const auto& selectionParams = state.getChildWithName(juce::Identifier("Random Box Selection"));
+    p.numRooms = (unsigned int)(int)selectionParams.getProperty(juce::Identifier("numRooms"), (int)p.numRooms);
+    p.allowTouching = selectionParams.getProperty(juce::Identifier("allowTouching"), p.allowTouching);
+
+    const auto& lineParams = state.getChildWithName(juce::Identifier("Line Connection"));
+    p.addBackProb = lineParams.getProperty(juce::Identifier("addBackProb"), p.addBackProb);
+    p.overlapPadding = (unsigned int)(int)lineParams.getProperty(juce::Identifier("overlapPadding"), (int)p.overlapPadding);
+    p.addBothDirection = lineParams.getProperty(juce::Identifier("addBothDirection"), p.addBothDirection);
+    p.firstHorizontalProb = lineParams.getProperty(juce::Identifier("firstHorizontalProb"), p.firstHorizontalProb);
+    p.maxRoomSize = (unsigned int)(int)lineParams.getProperty(juce::Identifier("maxRoomSize"), (int)p.maxRoomSize);
+    return p;
+}
+
+juce::ValueTree DungeonGenerationEngineBase::Parameters::toValueTree() const
+{
+    juce::ValueTree state(juce::Identifier("ROOT"));
+
+    juce::ValueTree basicTree(juce::Identifier("General"));
+    basicTree.setProperty(juce::Identifier("seed"), (int)seed, nullptr);
+    basicTree.setProperty(juce::Identifier("maxIteration"), (int)maxIteration, nullptr);
+    basicTree.setProperty(juce::Identifier("mapWidth"), (int)mapWidth, nullptr);
+    basicTree.setProperty(juce::Identifier("mapHeight"), (int)mapHeight, nullptr);
+    state.appendChild(basicTree, nullptr);
+
+    juce::ValueTree randBoxTree(juce::Identifier("Random Box Generation"));
+    randBoxTree.setProperty(juce::Identifier("useRectRegion"), useRectRegion, nullptr);
+    randBoxTree.setProperty(juce::Identifier("parallelSeparation"), parallelSeparation, nullptr);
+    randBoxTree.setProperty(juce::Identifier("radiusX"), radiusX, nullptr);
+    randBoxTree.setProperty(juce::Identifier("radiusY"), radiusY, nullptr);
+    randBoxTree.setProperty(juce::Identifier("numBox"), (int)numBox, nullptr);
+    randBoxTree.setProperty(juce::Identifier("smallBoxProb"), smallBoxProb, nullptr);
+    randBoxTree.setProperty(juce::Identifier("smallBoxRatioLimit"), smallBoxRatioLimit, nullptr);
+    randBoxTree.setProperty(juce::Identifier("largeBoxRatioLimit"), largeBoxRatioLimit, nullptr);
+    randBoxTree.setProperty(juce::Identifier("largeBoxRadiusMul"), largeBoxRadiusMul, nullptr);
+    randBoxTree.setProperty(juce::Identifier("smallBoxUseNormalDist"), smallBoxUseNormalDist, nullptr);
+    randBoxTree.setProperty(juce::Identifier("smallBoxDistUnifA"), smallBoxDistUnifA, nullptr);
+    randBoxTree.setProperty(juce::Identifier("smallBoxDistUnifB"), smallBoxDistUnifB, nullptr);
+    randBoxTree.setProperty(juce::Identifier("smallBoxDistMu"), smallBoxDistMu, nullptr);
+    randBoxTree.setProperty(juce::Identifier("smallBoxDistSigma"), smallBoxDistSigma, nullptr);
+    randBoxTree.setProperty(juce::Identifier("largeBoxUseNormalDist"), largeBoxUseNormalDist, nullptr);
+    randBoxTree.setProperty(juce::Identifier("largeBoxDistUnifA"), largeBoxDistUnifA, nullptr);
+    randBoxTree.setProperty(juce::Identifier("largeBoxDistUnifB"), largeBoxDistUnifB, nullptr);
+    randBoxTree.setProperty(juce::Identifier("largeBoxDistMu"), largeBoxDistMu, nullptr);
+    randBoxTree.setProperty(juce::Identifier("largeBoxDistSigma"), largeBoxDistSigma, nullptr);
+    state.appendChild(randBoxTree, nullptr);
+
+    juce::ValueTree randBoxSelect(juce::Identifier("Random Box Selection"));
+    randBoxSelect.setProperty(juce::Identifier("numRooms"), (int)numRooms, nullptr);
+    randBoxSelect.setProperty(juce::Identifier("allowTouching"), allowTouching, nullptr);
+    state.appendChild(randBoxSelect, nullptr);
+
+    juce::ValueTree otherTree(juce::Identifier("Line Connection"));
+    otherTree.setProperty(juce::Identifier("addBackProb"), addBackProb, nullptr);
+    otherTree.setProperty(juce::Identifier("overlapPadding"), (int)overlapPadding, nullptr);
+    otherTree.setProperty(juce::Identifier("addBothDirection"), addBothDirection, nullptr);
+    otherTree.setProperty(juce::Identifier("firstHorizontalProb"), firstHorizontalProb, nullptr);
+    otherTree.setProperty(juce::Identifier("maxRoomSize"), (int)maxRoomSize, nullptr);
+    state.appendChild(otherTree, nullptr);
+
+    return state;
+}
+
+//==============================================================================
+juce::var DungeonGenerationEngineBase::Stats::toVar() const
+{
+    auto* stages = new juce::DynamicObject();
+    for (int i = 0; i < numSteps; i++)
+        if (stageRan[i])
+            stages->setProperty(juce::Identifier(stageNames[i]), stageMs[i]);
+
+    auto* obj = new juce::DynamicObject();
+    obj->setProperty(juce::Identifier("stageMs"), juce::var(stages));
+    obj->setProperty(juce::Identifier("candidates"), (juce::int64)candidates);
+    obj->setProperty(juce::Identifier("rejectedRatio"), (juce::int64)rejectedRatio);
+    obj->setProperty(juce::Identifier("rejectedDuplicate"), (juce::int64)rejectedDuplicate);
+    obj->setProperty(juce::Identifier("overlapTests"), (juce::int64)overlapTests);
+    obj->setProperty(juce::Identifier("moveAwayCalls"), (juce::int64)moveAwayCalls);
+    obj->setProperty(juce::Identifier("separationRounds"), separationRounds);
+    obj->setProperty(juce::Identifier("residualOverlaps"), (juce::int64)residualOverlaps);
+    obj->setProperty(juce::Identifier("triangles"), (juce::int64)triangles);
+    obj->setProperty(juce::Identifier("tilesWritten"), (juce::int64)tilesWritten);
+    return juce::var(obj);
+}
+
+static std::uint64_t hashCombine(std::uint64_t h, std::uint64_t v)
+{
+    h ^= v + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+    return h;
+}
+
+static std::uint64_t hashCombine(std::uint64_t h, float v)
+{
+    std::uint32_t b;
+    std::memcpy(&b, &v, sizeof(b));
+    return hashCombine(h, (std::uint64_t)b);
+}
+
+std::array<std::uint64_t, DungeonGenerationEngineBase::numSteps> DungeonGenerationEngineBase::stageHashes(const Parameters& p)
+{
+    std::array<std::uint64_t, numSteps> hashes{};
+    std::uint64_t h = 0;
+
+    // randBox
+    h = hashCombine(h, (std::uint64_t)p.seed);
+    h = hashCombine(h, (std::uint64_t)p.useRectRegion);
+    h = hashCombine(h, p.radiusX);
+    h = hashCombine(h, p.radiusY);
+    h = hashCombine(h, (std::uint64_t)p.numBox);
+    h = hashCombine(h, (std::uint64_t)p.maxIteration);
+    h = hashCombine(h, p.smallBoxProb);
+    h = hashCombine(h, (std::uint64_t)p.smallBoxUseNormalDist);
+    h = hashCombine(h, p.smallBoxUseNormalDist ? p.smallBoxDistMu : p.smallBoxDistUnifA);
+    h = hashCombine(h, p.smallBoxUseNormalDist ? p.smallBoxDistSigma : p.smallBoxDistUnifB);
+    h = hashCombine(h, p.smallBoxRatioLimit);
+    h = hashCombine(h, (std::uint64_t)p.largeBoxUseNormalDist);
+    h = hashCombine(h, p.largeBoxUseNormalDist ? p.largeBoxDistMu : p.largeBoxDistUnifA);
+    h = hashCombine(h, p.largeBoxUseNormalDist ? p.largeBoxDistSigma : p.largeBoxDistUnifB);
+    h = hashCombine(h, p.largeBoxRatioLimit);
+    h = hashCombine(h, p.largeBoxRadiusMul);
+    hashes[0] = h;
+    // separateBox
+    h = hashCombine(h, (std::uint64_t)p.parallelSeparation);
+    hashes[1] = h = hashCombine(h, (std::uint64_t)1);
+    // centerAndCropBox
+    h = hashCombine(h, (std::uint64_t)p.mapWidth);
+    hashes[2] = h = hashCombine(h, (std::uint64_t)p.mapHeight);
+    // randSelect
+    h = hashCombine(h, (std::uint64_t)p.numRooms);
+    hashes[3] = h = hashCombine(h, (std::uint64_t)p.allowTouching);
+    // triangulate
+    hashes[4] = h = hashCombine(h, (std::uint64_t)4);
+    // mst
+    hashes[5] = h = hashCombine(h, (std::uint64_t)5);
+    // addSomeEdgesBack
+    h = hashCombine(h, (std::uint64_t)p.seed);
+    hashes[6] = h = hashCombine(h, p.addBackProb);
+    // lineConnect
+    h = hashCombine(h, (std::uint64_t)p.seed);
+    h = hashCombine(h, (std::uint64_t)p.overlapPadding);
+    h = hashCombine(h, (std::uint64_t)p.addBothDirection);
+    hashes[7] = h = hashCombine(h, p.firstHorizontalProb);
+    // selectCorridors
+    hashes[8] = h = hashCombine(h, (std::uint64_t)p.maxRoomSize);
+    // tiling
+    h = hashCombine(h, (std::uint64_t)p.mapWidth);
+    hashes[9] = h = hashCombine(h, (std::uint64_t)p.mapHeight);
+    return hashes;
+}
+
+template <typename Coord>
+typename BasicDungeonGenerationEngine<Coord>::Dungeon BasicDungeonGenerationEngine<Coord>::generate(const Parameters& p, int lastStep, StageCache* cache)
+{
+    lastStep = std::min(lastStep, numSteps - 1);
+    if (stats != nullptr)
+        stats->reset();
+    Dungeon d;
+    int s = 0;
+    if (cache == nullptr)
+    {
+        for (; s <= lastStep && !isCancelled(); s++)
+            runStep(s, p, d);
+        return d;
+    }
+
+    auto hashes = stageHashes(p);
+    while (s <= lastStep && cache->valid[s] && cache->hashes[s] == hashes[s])
+    {
+        if (stats != nullptr)
+            stats->stageCached[s] = true;
+        s++;
+    }
+    if (s > 0)
+        restoreSnapshot(cache->outputs[s - 1], d);
+    for (; s <= lastStep; s++)
+    {
+        runStep(s, p, d);
+        if (isCancelled())
+            break;
+        auto& snapshot = cache->outputs[s];
+        snapshot = s > 0 ? cache->outputs[s - 1] : typename StageCache::Snapshot();
+        storeStageOutput(s, d, snapshot);
+        cache->hashes[s] = hashes[s];
+        cache->valid[s] = true;
+    }
+    return d;
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::storeStageOutput(int step, const Dungeon& d, typename StageCache::Snapshot& snapshot)
+{
+    // Must agree with the fields runStage writes for each step.
+    switch (step)
+    {
+    case 0:
+    case 1:
+    case 2:
+        snapshot.boxes = std::make_shared<const RoomBoxVec>(d.boxes);
+        break;
+    case 3:
+        snapshot.boxes = std::make_shared<const RoomBoxVec>(d.boxes);
+        snapshot.rooms = std::make_shared<const RoomBoxVec>(d.rooms);
+        break;
+    case 4:
+        snapshot.edges = std::make_shared<const EdgeGraph>(d.edges);
+        break;
+    case 5:
+    case 6:
+        snapshot.mst_edges = std::make_shared<const EdgeSet>(d.mst_edges);
+        break;
+    case 7:
+        snapshot.lines = std::make_shared<const LineSet>(d.lines);
+        break;
+    case 8:
+        snapshot.boxes = std::make_shared<const RoomBoxVec>(d.boxes);
+        snapshot.corridors = std::make_shared<const RoomBoxVec>(d.corridors);
+        break;
+    case 9:
+        snapshot.tiles = std::make_shared<const TileGrid>(d.tiles);
+        break;
+    default:
+        break;
+    }
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::restoreSnapshot(const typename StageCache::Snapshot& snapshot, Dungeon& d)
+{
+    auto copyOf = [](const auto& field)
+    {
+        using Field = typename std::decay_t<decltype(field)>::element_type;
+        return field != nullptr ? *field : Field();
+    };
+    d.boxes = copyOf(snapshot.boxes);
+    d.rooms = copyOf(snapshot.rooms);
+    d.corridors = copyOf(snapshot.corridors);
+    d.edges = copyOf(snapshot.edges);
+    d.mst_edges = copyOf(snapshot.mst_edges);
+    d.lines = copyOf(snapshot.lines);
+    d.tiles = copyOf(snapshot.tiles);
+    d.generated = snapshot.tiles != nullptr;
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::generate(const Parameters& p, Dungeon& d, int lastStep)
+{
+    lastStep = std::min(lastStep, numSteps - 1);
+    if (stats != nullptr)
+        stats->reset();
+    d.generated = false;
+    for (int s = 0; s <= lastStep && !isCancelled(); s++)
+        runStep(s, p, d);
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::runStep(int step, const Parameters& p, Dungeon& d)
+{
+    if (stats != nullptr && step >= 0 && step < numSteps)
+    {
+        auto start = std::chrono::steady_clock::now();
+        runStage(step, p, d);
+        stats->stageMs[step] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        stats->stageRan[step] = true;
+        return;
+    }
+    runStage(step, p, d);
+}
+
+template <typename Coord>
+void BasicDungeonGenerationEngine<Coord>::runStage(int step, const Parameters& p, Dungeon& d)
+{
+    // Each stage's previous output goes back to the workspace first, so the
+    // stage can rebuild it in the same storage.
+    auto recycle = [this](auto& output)
+    {
+        if (workspace != nullptr)
+            workspace->recycle(std::move(output));
+    };
+
+    switch (step)
+    {
+    case 0:
+        recycle(d.boxes);
+        d.boxes = randBox(
+            p.seed, p.useRectRegion, p.radiusX, p.radiusY,
+            p.numBox, p.maxIteration,
+            p.smallBoxProb, p.smallBoxUseNormalDist,
+            p.smallBoxUseNormalDist ? p.smallBoxDistMu : p.smallBoxDistUnifA, p.smallBoxUseNormalDist ? p.smallBoxDistSigma : p.smallBoxDistUnifB,
+            p.smallBoxRatioLimit,
+            p.largeBoxUseNormalDist,
+            p.largeBoxUseNormalDist ? p.largeBoxDistMu : p.largeBoxDistUnifA, p.largeBoxUseNormalDist ? p.largeBoxDistSigma : p.largeBoxDistUnifB,
+            p.largeBoxRatioLimit, p.largeBoxRadiusMul);
+        break;
+    case 1:
+        d.boxes = p.parallelSeparation ? separateBoxParallel(std::move(d.boxes)) : separateBox(std::move(d.boxes));
+        break;
+    case 2:
+        d.boxes = centerAndCropBox(std::move(d.boxes), p.mapWidth, p.mapHeight);
+        break;
+    case 3:
+    {
+        recycle(d.rooms);
+        auto ret = randSelect(std::move(d.boxes), p.numRooms, p.allowTouching);
+        d.boxes = std::move(ret.first);
+        d.rooms = std::move(ret.second);
+        break;
+    }
+    case 4:
+        recycle(d.edges);
+        d.edges = triangulate(d.rooms);
+        break;
+    case 5:
+        recycle(d.mst_edges);
+        d.mst_edges = mst(d.edges);
+        break;
+    case 6:
+        d.mst_edges = addSomeEdgesBack(p.seed, d.edges, std::move(d.mst_edges), p.addBackProb);
+        break;
+    case 7:
+        recycle(d.lines);
+        d.lines = lineConnect(p.seed, d.rooms, d.mst_edges, p.overlapPadding, p.addBothDirection, p.firstHorizontalProb);
+        break;
+    case 8:
+    {
+        recycle(d.corridors);
+        auto ret = selectCorridors(std::move(d.boxes), d.lines, p.maxRoomSize);
+        d.boxes = std::move(ret.first);
+        d.corridors = std::move(ret.second);
+        break;
+    }
+    case 9:
+        recycle(d.tiles);
+        d.tiles = tiling(d.rooms, d.corridors, d.lines, p.mapWidth, p.mapHeight);
+        d.generated = true;
+        break;
+    default:
+        break;
+    }
+}
+
+//==============================================================================
+template struct BasicDungeonGenerationEngine<double>;
+template struct BasicDungeonGenerationEngine<float>;
+template struct BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>;
@@ -11,53 +11,563 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "delaunator.h"
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
 #include <random>
 #include <numeric>
 #include <set>
-#include <queue>
 #include <limits>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <type_traits>
 
-struct DungeonGenerationEngine
+// Define DUNGEON_GEN_PMR=1 to allocate GenerationWorkspace scratch arrays from a
+// std::pmr::memory_resource (needs a standard library that ships <memory_resource>).
+#ifndef DUNGEON_GEN_PMR
+ #define DUNGEON_GEN_PMR 0
+#endif
+#if DUNGEON_GEN_PMR
+ #include <memory_resource>
+#endif
+
+// The parts of the engine that do not depend on how box coordinates are
+// stored: random numbers, the graph and tile containers, the scratch space and
+// graph stages that work on them, parameters, stats and threading/cancellation
+// settings.
+struct DungeonGenerationEngineBase
+{
+    //==============================================================================
+    // Counter-based random numbers. Philox4x32-10 maps (key, counter) to four
+    // random words with no state in between, so sample i of a stream can be drawn
+    // without drawing samples 0..i-1, on any thread. The distributions are built
+    // from integer arithmetic and IEEE basic operations only (no <random>
+    // distributions, no libm), so a seed gives the same dungeon with every
+    // compiler and standard library.
+    struct Philox
+    {
+        static std::array<std::uint32_t, 4> generate(std::array<std::uint32_t, 4> counter, std::array<std::uint32_t, 2> key);
+    };
+
+    // Stream ids, so each stage draws independent numbers from the same seed.
+    enum class RandomStreamId : std::uint32_t
+    {
+        randBox = 0,
+        addSomeEdgesBack = 1,
+        lineConnect = 2,
+        direction = 3
+    };
+
+    struct RandomStream
+    {
+        // Words come from counters (index, 0), (index, 1), ... under key (seed, stream).
+        RandomStream(std::uint32_t seed, RandomStreamId stream, std::uint64_t index);
+
+        std::uint32_t nextUInt32();
+        // [0, 1) with 24 random bits, the resolution of a float.
+        float nextFloat();
+        // Uniform in [a, b], unbiased (Lemire's multiply-and-reject).
+        int nextInt(int a, int b);
+        // Two independent N(mu, sigma) samples (Box-Muller).
+        std::pair<float, float> nextNormalPair(float mu, float sigma);
+
+    private:
+        std::array<std::uint32_t, 2> key;
+        std::uint64_t index;
+        std::uint64_t block = 0;
+        std::array<std::uint32_t, 4> words{};
+        int used = 4;
+    };
+
+    // Box coordinate of the fixed-point engine: a signed 32-bit count of 1/256
+    // tiles (Q23.8). Every computation that moves, compares or measures a box is
+    // done on raw in integers (see the FixedCoord specialisations in the .cpp);
+    // the implicit conversion to double, which is exact, only lets the
+    // coordinate-independent stages read a position. Coordinates are kept
+    // within +-2^29 raw units (2^21 tiles) so sums of two never overflow.
+    struct FixedCoord
+    {
+        static constexpr int fractionBits = 8;
+        static constexpr std::int32_t one = 1 << fractionBits;
+
+        static FixedCoord fromRaw(std::int64_t raw) { FixedCoord c; c.raw = (std::int32_t)raw; return c; }
+        operator double() const { return raw * (1.0 / one); }
+
+        friend bool operator==(FixedCoord a, FixedCoord b) { return a.raw == b.raw; }
+        friend bool operator!=(FixedCoord a, FixedCoord b) { return a.raw != b.raw; }
+        friend bool operator<(FixedCoord a, FixedCoord b) { return a.raw < b.raw; }
+
+        std::int32_t raw = 0;
+    };
+
+    struct CentreHashSet
+    {
+        // Open-addressing set over the exact bit patterns of a box centre, i.e. the
+        // same duplicate rule as RoomBoxComp without a tree node per candidate.
+        CentreHashSet() = default;
+        explicit CentreHashSet(size_t expected);
+
+        // Empties the set and sizes it for expected keys, reusing its storage.
+        void reset(size_t expected);
+        bool insert(double cx, double cy);
+
+    private:
+        struct Slot
+        {
+            std::uint64_t x = 0, y = 0;
+            bool used = false;
+        };
+
+        bool insertKey(std::uint64_t x, std::uint64_t y);
+        void grow();
+
+        std::vector<Slot> slots;
+        size_t count = 0;
+    };
+    struct EdgeGraph
+    {
+        // Undirected weighted graph in CSR form: the neighbours of node u are
+        // neighbours[offsets[u] .. offsets[u + 1]), in ascending order, with the
+        // matching weights. Every edge appears once from each end.
+        int getNumNodes() const { return offsets.empty() ? 0 : (int)offsets.size() - 1; }
+        size_t getNumEdges() const { return neighbours.size() / 2; }
+        bool empty() const { return neighbours.empty(); }
+
+        std::vector<int> offsets;
+        std::vector<int> neighbours;
+        std::vector<double> weights;
+    };
+
+    struct TileGrid
+    {
+        // Tile map packed at 2 bits per tile (values 0-3), 32 tiles per word.
+        // Each row starts on a fresh word so rows can be filled and copied
+        // independently. Tile (x, y) is at bit 2 * (x % 32) of word x / 32 of row y.
+        static constexpr int bitsPerTile = 2;
+        static constexpr int tilesPerWord = 64 / bitsPerTile;
+
+        TileGrid() = default;
+        TileGrid(int width, int height);
+        // Resizes to width x height with every tile 0, keeping the word storage.
+        void reset(int width, int height);
+
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        bool empty() const { return words.empty(); }
+        int getWordsPerRow() const { return wordsPerRow; }
+        const std::uint64_t* getRow(int y) const { return words.data() + (size_t)y * wordsPerRow; }
+        size_t getNumBytes() const { return words.size() * sizeof(std::uint64_t); }
+
+        int get(int x, int y) const
+        {
+            auto word = words[(size_t)y * wordsPerRow + x / tilesPerWord];
+            return (int)((word >> (bitsPerTile * (x % tilesPerWord))) & 3);
+        }
+        void set(int x, int y, int value)
+        {
+            auto& word = words[(size_t)y * wordsPerRow + x / tilesPerWord];
+            int shift = bitsPerTile * (x % tilesPerWord);
+            word = (word & ~((std::uint64_t)3 << shift)) | ((std::uint64_t)(value & 3) << shift);
+        }
+        // Sets tiles [x0, x1) of row y to value, a word at a time.
+        void fillRowSpan(int y, int x0, int x1, int value);
+        // Sets tiles [x0, x1) of rows [y0, y1) to value. The edge masks and the
+        // value pattern are worked out once for the whole rect.
+        void fillRect(int x0, int y0, int x1, int y1, int value);
+
+        // Row-major, one int per tile, as consumed by the JSON writer and older callers.
+        std::vector<int> toVector() const;
+
+    private:
+        int width{ 0 }, height{ 0 }, wordsPerRow{ 0 };
+        std::vector<std::uint64_t> words;
+    };
+
+    //==============================================================================
+
+    using EdgeSet = std::set<std::pair<int, int>>;
+    using LineSet = std::set<std::tuple<double, double, double, double>>;
+
+#if DUNGEON_GEN_PMR
+    template <typename T>
+    using ScratchVector = std::pmr::vector<T>;
+#else
+    template <typename T>
+    using ScratchVector = std::vector<T>;
+#endif
+
+    //==============================================================================
+    // The part of a GenerationWorkspace (see BasicDungeonGenerationEngine) that
+    // does not hold boxes: scratch for the graph stages and the separation
+    // cells, and the pools of graph, tile and set storage.
+    struct WorkspaceBase
+    {
+#if DUNGEON_GEN_PMR
+        explicit WorkspaceBase(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+#else
+        WorkspaceBase() = default;
+#endif
+
+        struct BoxCandidate
+        {
+            double cx, cy;
+            float w, h;
+            bool rejected;
+        };
+        struct SeparationCell
+        {
+            int x, y;
+            int begin, end;
+        };
+
+        // randBox
+        ScratchVector<BoxCandidate> candidates;
+        CentreHashSet centres;
+
+        // separateBox, separateBoxParallel
+        std::vector<int> gridHits;
+        ScratchVector<std::pair<double, double>> directions;
+        ScratchVector<std::pair<long long, int>> cellOwners;
+        ScratchVector<int> cellOrder;
+        ScratchVector<long long> cellKeys;
+        ScratchVector<SeparationCell> cells;
+        ScratchVector<int> phaseCells;
+        std::vector<std::vector<int>> workerCandidates;
+
+        // triangulate (Delaunator reads a std::vector)
+        std::vector<double> coords;
+        delaunator::Delaunator triangulator;
+        ScratchVector<std::pair<int, int>> arcs;
+
+        // mst
+        ScratchVector<std::pair<int, double>> heap;
+        ScratchVector<double> key;
+        ScratchVector<int> parent;
+        ScratchVector<char> inMst;
+
+        // Storage recycled from the Dungeon containers a stage is about to replace.
+        EdgeGraph takeGraph();
+        TileGrid takeTiles(int width, int height);
+        void recycle(EdgeGraph&& graph);
+        void recycle(TileGrid&& tiles);
+        void recycle(EdgeSet&& edges);
+        void recycle(LineSet&& lines);
+        // Inserts into set, reusing a recycled node when there is one.
+        void insert(EdgeSet& edges, const std::pair<int, int>& edge);
+        void insert(LineSet& lines, const std::tuple<double, double, double, double>& line);
+
+    private:
+        std::vector<EdgeGraph> spareGraphs;
+        std::vector<TileGrid> spareTiles;
+        std::vector<EdgeSet::node_type> spareEdgeNodes;
+        std::vector<LineSet::node_type> spareLineNodes;
+    };
+
+    //==============================================================================
+    // Full pipeline, shared by the editor and the headless batch generator.
+    // Field names match the properties of the editor's ValueTree state.
+
+    struct Parameters
+    {
+        static Parameters fromValueTree(const juce::ValueTree& state);
+        juce::ValueTree toValueTree() const;
+
+        // General
+        unsigned int seed = 0;
+        unsigned int maxIteration = 1000 * 100; // caps boxes kept by randBox
+        unsigned int mapWidth = 64;
+        unsigned int mapHeight = 64;
+
+        // Random Box Generation
+        bool useRectRegion = false;
+        bool parallelSeparation = false;
+        float radiusX = 8.0f;
+        float radiusY = 8.0f;
+        unsigned int numBox = 100;
+        float smallBoxProb = 0.9f;
+        float smallBoxRatioLimit = 4.f;
+        float largeBoxRatioLimit = 3.f;
+        float largeBoxRadiusMul = 0.65f;
+        bool smallBoxUseNormalDist = false;
+        float smallBoxDistUnifA = 1.f;
+        float smallBoxDistUnifB = 4.f;
+        float smallBoxDistMu = 2.f;
+        float smallBoxDistSigma = 2.f;
+        bool largeBoxUseNormalDist = false;
+        float largeBoxDistUnifA = 8.f;
+        float largeBoxDistUnifB = 12.f;
+        float largeBoxDistMu = 8.f;
+        float largeBoxDistSigma = 2.f;
+
+        // Random Box Selection
+        unsigned int numRooms = 12;
+        bool allowTouching = false;
+
+        // Line Connection
+        float addBackProb = 0.1f;
+        unsigned int overlapPadding = 3;
+        bool addBothDirection = false;
+        float firstHorizontalProb = 0.5f;
+        unsigned int maxRoomSize = 12;
+    };
+
+    static constexpr int numSteps = 10;
+    static constexpr const char* stageNames[numSteps] = {
+        "randBox", "separateBox", "centerAndCropBox", "randSelect", "triangulate",
+        "mst", "addSomeEdgesBack", "lineConnect", "selectCorridors", "tiling"
+    };
+
+    static std::array<std::uint64_t, numSteps> stageHashes(const Parameters& params);
+
+    //==============================================================================
+    // Optional instrumentation. When stats is set, runStep records each stage's
+    // wall time and the stages add their counters; hot loops count into locals
+    // and publish once, so a null stats costs a branch per stage. generate()
+    // resets it first, so it describes the latest run: a step either ran, was
+    // taken from a StageCache (stageCached), or was past lastStep and neither.
+    struct Stats
+    {
+        void reset() { *this = Stats(); }
+        juce::var toVar() const;
+
+        std::array<double, numSteps> stageMs{};
+        std::array<bool, numSteps> stageRan{};
+        std::array<bool, numSteps> stageCached{};
+
+        // randBox
+        std::uint64_t candidates = 0;
+        std::uint64_t rejectedRatio = 0;
+        std::uint64_t rejectedDuplicate = 0;
+
+        // separateBox
+        std::uint64_t overlapTests = 0;
+        std::uint64_t moveAwayCalls = 0;
+        int separationRounds = 0;
+        std::uint64_t residualOverlaps = 0;
+
+        // triangulate
+        std::uint64_t triangles = 0;
+
+        // tiling
+        std::uint64_t tilesWritten = 0;
+    };
+
+    Stats* stats = nullptr;
+
+    //==============================================================================
+    // Optional cancellation token for callers running the engine on a worker
+    // thread. Long stages poll it and return early.
+    std::atomic<bool>* cancelFlag = nullptr;
+
+    // Worker threads for the parallel stages; 0 uses every hardware thread.
+    // Results never depend on it.
+    int numThreads = 0;
+    bool isCancelled() const { return cancelFlag != nullptr && cancelFlag->load(std::memory_order_relaxed); }
+
+protected:
+    // The graph stages, which only see room indices and edge weights. Each takes
+    // its scratch and pooled storage from workspace, or from temporaries when
+    // it is null.
+    //
+    // Delaunay graph over the room centres in ws.coords (x, y pairs), with the
+    // weights left empty: rooms are joined along triangle edges, or along the
+    // hull when every centre lies on one line.
+    EdgeGraph triangulateCentres(WorkspaceBase& ws);
+    EdgeSet mst(const EdgeGraph& edges, WorkspaceBase* workspace);
+    EdgeSet addSomeEdgesBack(unsigned int seed, const EdgeGraph& edges, EdgeSet mst_edges,
+        float addBackProb, WorkspaceBase* workspace);
+};
+
+//==============================================================================
+// The pipeline, templated on the type box coordinates are stored in. With
+// double (DungeonGenerationEngine) it is the reference engine; float halves a
+// RoomBox to 24 bytes and doubles the lanes of the SIMD overlap kernels.
+// FixedCoord (FixedDungeonGenerationEngine) also keeps a RoomBox at 24 bytes
+// but does all box arithmetic in integers, so its output does not depend on
+// how the compiler or CPU rounds floating point. Stored coordinates are
+// rounded to Coord after every step, so the three produce different, equally
+// deterministic dungeons from the same parameters. Only these three are
+// instantiated (in the .cpp).
+template <typename Coord>
+struct BasicDungeonGenerationEngine : DungeonGenerationEngineBase
 {
     struct RoomBox
     {
         RoomBox(double cx, double cy, double w, double h);
         bool operator<(const RoomBox& other) const;
 
-        double getDistance() const;
+        // Sort key for the distance from the origin: the distance itself, or for
+        // FixedCoord the exact squared distance in raw units.
+        using Distance = typename std::conditional<std::is_same<Coord, FixedCoord>::value, std::int64_t, double>::type;
+
+        Distance getDistance() const;
         double getHamiltonDist(const RoomBox& other) const;
         double getSize() const;
+        // Unit directions away from fixed and, as separation pushes boxes,
+        // outwards through the centre. moveAwayFrom only uses their signs and
+        // ratio, so FixedCoord returns them unnormalised, in raw units.
         std::pair<double, double> getDirection(const RoomBox& fixed) const;
+        std::pair<double, double> getOutwardDirection() const;
 
         bool isOverlap(const RoomBox& other) const;
         bool isTouching(const RoomBox& other) const;
-        bool isTouchingLine(std::tuple<double, double, double, double> line);
+        bool isTouchingLine(const std::tuple<double, double, double, double>& line) const;
 
         void snapToGrid();
         void moveDelta(double dx, double dy);
         void moveAwayFrom(const RoomBox& fixed, double dirx, double diry);
 
-        double x, cx;
-        double y, cy;
-        double w;
-        double h;
+        Coord x, cx;
+        Coord y, cy;
+        Coord w;
+        Coord h;
+    };
+    struct RoomBoxSoA
+    {
+        // Structure-of-arrays copy of a RoomBoxVec. The find* kernels test one box
+        // against a block of others at a time (2 doubles, 4 floats or 4 FixedCoords
+        // with SSE2, 4 or 8 doubles/floats with AVX, with a scalar tail), and give the same
+        // answers as RoomBox::isOverlap/isTouching.
+        RoomBoxSoA() = default;
+        explicit RoomBoxSoA(const std::vector<RoomBox>& boxes);
+        std::vector<RoomBox> toVec() const;
+        // Like the constructor and toVec, but reusing existing capacity.
+        void assign(const std::vector<RoomBox>& boxes);
+        void copyTo(std::vector<RoomBox>& boxes) const;
+
+        size_t size() const { return cx.size(); }
+        void reserve(size_t n);
+        void clear();
+        void push_back(const RoomBox& box);
+        RoomBox get(size_t i) const;
+        void set(size_t i, const RoomBox& box);
+
+        // Index of the first box in [begin, end) overlapping/touching box, or end.
+        size_t findFirstOverlap(const RoomBox& box, size_t begin, size_t end) const;
+        size_t findFirstTouching(const RoomBox& box, size_t begin, size_t end) const;
+
+        std::vector<Coord> x, cx;
+        std::vector<Coord> y, cy;
+        std::vector<Coord> w;
+        std::vector<Coord> h;
+    };
+    struct BoxGrid
+    {
+        // Uniform bucket grid over box footprints, used as a broadphase so a box
+        // is only tested against boxes in the cells it covers.
+        explicit BoxGrid(double cellSize);
+        static double suggestCellSize(const std::vector<RoomBox>& boxes);
+        static double suggestCellSize(const RoomBoxSoA& boxes);
+
+        // Empties the grid, keeping its storage so refilling it does not allocate.
+        void reset(double cellSize);
+
+        void insert(int idx, const RoomBox& box);
+        void remove(int idx, const RoomBox& box);
+        // Appends indices of boxes sharing a cell with box, possibly repeated.
+        void query(const RoomBox& box, std::vector<int>& result) const;
+
+    private:
+        void cellRange(const RoomBox& box, int& x0, int& y0, int& x1, int& y1) const;
+        static long long cellKey(int x, int y);
+        // Open-addressing table from cell key to a list in cellLists; lists are
+        // handed out in order and keep their capacity across reset().
+        int findCell(long long key) const; // list index, or -1
+        std::vector<int>& getOrAddCell(long long key);
+        void growTable();
+
+        struct Slot
+        {
+            long long key;
+            int list; // -1 if empty
+        };
+
+        double cellSize;
+        std::vector<Slot> table;
+        std::vector<std::vector<int>> cellLists;
+        size_t numCells = 0;
     };
     struct RoomBoxComp
     {
         constexpr bool operator()(const RoomBox& lhs, const RoomBox& rhs) const;
     };
-    struct CustomTupleComp
+
+    using RoomBoxVec = std::vector<RoomBox>;
+
+    struct LineIndex
     {
-        constexpr bool operator()(const std::tuple<int, int, double>& lhs, const std::tuple<int, int, double>& rhs) const;
+        // Axis-aligned segments bucketed by orientation and sorted by their fixed
+        // coordinate, so the lines near a box are found with a range query.
+        LineIndex() = default;
+        explicit LineIndex(const LineSet& lines);
+        // Rebuilds the index for lines, reusing its storage.
+        void assign(const LineSet& lines);
+        bool isTouching(const RoomBox& box) const;
+
+    private:
+        struct Segment
+        {
+            double fixed, lo, hi;
+            std::tuple<double, double, double, double> line;
+            bool operator<(const Segment& other) const { return fixed < other.fixed; }
+        };
+        static bool anyTouching(const std::vector<Segment>& segments, const RoomBox& box,
+            double fixedCentre, double fixedHalf, double spanCentre, double spanHalf);
+
+        std::vector<Segment> horizontal, vertical;
     };
 
+    struct Dungeon;
+
     //==============================================================================
+    // Scratch buffers for the pipeline, kept between calls so their capacity is
+    // reused. Point the engine's workspace at one and, once a few dungeons of
+    // the largest size have been generated, the stages stop allocating:
+    // temporary arrays live here, and the containers a stage overwrites in a
+    // Dungeon are recycled into the pools below and handed back out to the stage
+    // that rebuilds them (set nodes included, via node handles), and the
+    // Delaunay triangulator is re-run in place. What is not covered is the
+    // worker threads started by the parallel stages when numThreads != 1, so a
+    // batch gives each of its threads an engine and a workspace of its own.
+    //
+    // With DUNGEON_GEN_PMR the ScratchVector arrays draw from the given memory
+    // resource; the pooled containers keep the standard allocator because they
+    // are handed to callers as part of a Dungeon. A workspace must only be used
+    // by one engine call at a time.
+    struct GenerationWorkspace : WorkspaceBase
+    {
+#if DUNGEON_GEN_PMR
+        explicit GenerationWorkspace(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+#else
+        GenerationWorkspace() = default;
+#endif
 
-    using WeightedEdgeSet = std::set<std::tuple<int, int, double>, CustomTupleComp>;
-    using EdgeSet = std::set<std::pair<int, int>>;
-    using RoomBoxVec = std::vector<RoomBox>;
-    using LineSet = std::set<std::tuple<double, double, double, double>>;
+        // randBox
+        ScratchVector<std::pair<typename RoomBox::Distance, RoomBox>> keyedBoxes;
+
+        // separateBox, separateBoxParallel
+        RoomBoxSoA boxesSoA;
+        BoxGrid grid{ 1.0 };
+
+        // randSelect
+        RoomBoxSoA roomsSoA;
+
+        // selectCorridors
+        LineIndex lineIndex;
+        ScratchVector<RoomBox> pickedBoxes;
+
+        using WorkspaceBase::recycle;
+        RoomBoxVec takeBoxes();
+        void recycle(RoomBoxVec&& boxes);
+        // All of a dungeon that is no longer needed.
+        void recycle(Dungeon&& dungeon);
+
+    private:
+        std::vector<RoomBoxVec> spareBoxes;
+    };
 
     RoomBoxVec randBox(
         unsigned int seed, bool useRectRegion, float radiusX, float radiusY,
@@ -66,22 +576,139 @@ struct DungeonGenerationEngine
         bool largeBoxUseNormalDist, float largeBoxDistParamA, float largeBoxDistParamB, float largeBoxRatioLimit,
         float largeBoxRadiusMultiplier);
     RoomBoxVec separateBox(RoomBoxVec boxes);
+    RoomBoxSoA separateBox(RoomBoxSoA boxes);
+    // Parallel variant: boxes are owned by square cells at least as large as the
+    // biggest box, and the cells are processed in four checkerboard phases per
+    // round. Within a phase each cell applies the serial rule (push a box away
+    // from lower-indexed boxes it overlaps) to its own boxes, looking only at the
+    // 3x3 cells around it, none of which is being written by another thread. The
+    // result depends only on the input, never on numThreads or scheduling, but
+    // differs from separateBox. Rounds repeat until nothing overlaps or
+    // maxRounds is reached.
+    RoomBoxVec separateBoxParallel(RoomBoxVec boxes, int maxRounds = 100);
     RoomBoxVec centerAndCropBox(RoomBoxVec boxes, unsigned int mapWidth, unsigned int mapHeight);
     std::pair<RoomBoxVec, RoomBoxVec> randSelect(RoomBoxVec boxes, unsigned int numRooms, bool allowTouching);
-    WeightedEdgeSet triangulate(const RoomBoxVec& rooms);
-    EdgeSet mst(const WeightedEdgeSet& edges);
+    EdgeGraph triangulate(const RoomBoxVec& rooms);
+    EdgeSet mst(const EdgeGraph& edges) { return DungeonGenerationEngineBase::mst(edges, workspace); }
     EdgeSet addSomeEdgesBack(
         unsigned int seed,
-        const WeightedEdgeSet& edges,
+        const EdgeGraph& edges,
         EdgeSet mst_edges,
-        float addBackProb);
+        float addBackProb)
+    {
+        return DungeonGenerationEngineBase::addSomeEdgesBack(seed, edges, std::move(mst_edges), addBackProb, workspace);
+    }
     LineSet lineConnect(
         unsigned int seed, const RoomBoxVec& rooms, const EdgeSet& mst_edges,
         unsigned int overlapPadding, bool addBothDirection, float firstHorizontalProb);
     std::pair<RoomBoxVec, RoomBoxVec> selectCorridors(
         RoomBoxVec boxes, const LineSet& lines,
         unsigned int maxRoomSize);
-    std::vector<int> tiling(
+
+    // In-place forms of randSelect and selectCorridors. boxes is reordered so the
+    // boxes not picked come first and the picked rooms / corridors follow, each
+    // part in the same order as the pair returned above; the return value is the
+    // index where the picked part starts. Linear in the number of boxes (plus
+    // randSelect's sort), and allocation-free with a workspace.
+    size_t randSelectInPlace(RoomBoxVec& boxes, unsigned int numRooms, bool allowTouching);
+    size_t selectCorridorsInPlace(RoomBoxVec& boxes, const LineSet& lines, unsigned int maxRoomSize);
+    TileGrid tiling(
         const RoomBoxVec& rooms, const RoomBoxVec& corridors, const LineSet& lines,
         unsigned int mapWidth, unsigned int mapHeight);
+
+    // Rasterises only the window [x, x + width) x [y, y + height) of the map (in
+    // tile coordinates, origin at the top-left corner). The result matches the
+    // same window cut out of tiling(), so chunks can be built independently,
+    // in any order or in parallel.
+    TileGrid tilingChunk(
+        const RoomBoxVec& rooms, const RoomBoxVec& corridors, const LineSet& lines,
+        unsigned int mapWidth, unsigned int mapHeight,
+        int x, int y, int width, int height);
+
+    // Walks the map in chunkSize x chunkSize chunks, row by row, rasterising each
+    // one from just the rooms, corridors and lines that reach into it. Only one
+    // chunk is alive at a time, so peak memory depends on the chunk size rather
+    // than the map size.
+    void forEachChunk(
+        const RoomBoxVec& rooms, const RoomBoxVec& corridors, const LineSet& lines,
+        unsigned int mapWidth, unsigned int mapHeight, int chunkSize,
+        const std::function<void(int x, int y, const TileGrid& chunk)>& callback);
+
+    //==============================================================================
+    struct Dungeon
+    {
+        RoomBoxVec boxes;
+        RoomBoxVec rooms;
+        RoomBoxVec corridors;
+        EdgeGraph edges;
+        EdgeSet mst_edges;
+        LineSet lines;
+        TileGrid tiles;
+        bool generated{ false };
+    };
+
+    struct StageCache
+    {
+        // Snapshot of the dungeon after each step, keyed by a hash of that step's
+        // inputs: the previous step's hash plus the parameters the step reads.
+        // generate() resumes from the last step whose hash still matches.
+        // A snapshot copies only the fields its step wrote and shares the rest
+        // with the snapshot before it, so each field is held once per step that
+        // produces it rather than once per step.
+        struct Snapshot
+        {
+            std::shared_ptr<const RoomBoxVec> boxes, rooms, corridors;
+            std::shared_ptr<const EdgeGraph> edges;
+            std::shared_ptr<const EdgeSet> mst_edges;
+            std::shared_ptr<const LineSet> lines;
+            std::shared_ptr<const TileGrid> tiles;
+        };
+
+        std::array<std::uint64_t, numSteps> hashes{};
+        std::array<bool, numSteps> valid{};
+        std::array<Snapshot, numSteps> outputs;
+    };
+
+    // Stops at the first step interrupted by cancelFlag; a cancelled result is
+    // partial and is never stored in the cache.
+    Dungeon generate(const Parameters& params, int lastStep = numSteps - 1, StageCache* cache = nullptr);
+    // Regenerates into an existing dungeon, so with a workspace its containers
+    // are reused rather than reallocated.
+    void generate(const Parameters& params, Dungeon& dungeon, int lastStep = numSteps - 1);
+    void runStep(int step, const Parameters& params, Dungeon& dungeon);
+
+    // Optional scratch space shared by every call; without one each call
+    // allocates its own temporaries.
+    GenerationWorkspace* workspace = nullptr;
+
+private:
+    void separateBoxInPlace(RoomBoxSoA& boxes, GenerationWorkspace& ws);
+    // Moves boxes[split, end) into a vector of its own.
+    std::pair<RoomBoxVec, RoomBoxVec> splitBoxes(RoomBoxVec boxes, size_t split);
+    void runStage(int step, const Parameters& params, Dungeon& dungeon);
+    // Copies into snapshot the fields of dungeon that step writes.
+    static void storeStageOutput(int step, const Dungeon& dungeon, typename StageCache::Snapshot& snapshot);
+    static void restoreSnapshot(const typename StageCache::Snapshot& snapshot, Dungeon& dungeon);
 };
+
+// The integer versions of the RoomBox arithmetic for FixedCoord.
+template <> BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>::RoomBox::RoomBox(double cx, double cy, double w, double h);
+template <> BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>::RoomBox::Distance BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>::RoomBox::getDistance() const;
+template <> double BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>::RoomBox::getHamiltonDist(const RoomBox& other) const;
+template <> double BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>::RoomBox::getSize() const;
+template <> std::pair<double, double> BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>::RoomBox::getDirection(const RoomBox& fixed) const;
+template <> std::pair<double, double> BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>::RoomBox::getOutwardDirection() const;
+template <> bool BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>::RoomBox::isOverlap(const RoomBox& other) const;
+template <> bool BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>::RoomBox::isTouching(const RoomBox& other) const;
+template <> bool BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>::RoomBox::isTouchingLine(const std::tuple<double, double, double, double>& line) const;
+template <> void BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>::RoomBox::snapToGrid();
+template <> void BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>::RoomBox::moveDelta(double dx, double dy);
+template <> void BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>::RoomBox::moveAwayFrom(const RoomBox& fixed, double dirx, double diry);
+
+extern template struct BasicDungeonGenerationEngine<double>;
+extern template struct BasicDungeonGenerationEngine<float>;
+extern template struct BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>;
+
+using DungeonGenerationEngine = BasicDungeonGenerationEngine<double>;
+using FloatDungeonGenerationEngine = BasicDungeonGenerationEngine<float>;
+using FixedDungeonGenerationEngine = BasicDungeonGenerationEngine<DungeonGenerationEngineBase::FixedCoord>;
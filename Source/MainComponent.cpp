@@ -18,6 +18,93 @@ MainComponent::CanvasOverlayComponent::CanvasOverlayComponent(MainComponent* par
 }
 
 void MainComponent::CanvasOverlayComponent::paint(juce::Graphics& g)
+{
+    auto b2 = getLocalBounds();
+    int ox = b2.getCentreX() + viewDx;
+    int oy = b2.getCentreY() + viewDy;
+
+    paintLayer(g, sceneLayer, ox, oy, false);
+    if (generated)
+        paintLayer(g, tileLayer, ox, oy, true);
+}
+
+void MainComponent::CanvasOverlayComponent::paintLayer(juce::Graphics& g, CachedLayer& layer, int ox, int oy, bool tileGrid)
+{
+    // A layer caches the part of the map on screen plus a margin of a quarter
+    // of the view on each side, and drawing is culled to that part, so the
+    // cost follows the size of the window rather than of the map. Panning only
+    // moves the blit until the view leaves the cached area; a new result or
+    // zoom level starts over. Areas too large for an image are drawn directly.
+    static constexpr juce::int64 maxLayerPixels = 4096 * 2048;
+
+    if (!layer.valid || layer.scale != scale)
+    {
+        layer.valid = true;
+        layer.scale = scale;
+        layer.image = {};
+        layer.area = {};
+        auto content = (tileGrid ? getTileArea() : getSceneArea()) * (float)scale;
+        layer.content = content.expanded(8.0f).getSmallestIntegerContainer();
+    }
+
+    auto onScreen = getLocalBounds().translated(-ox, -oy).getIntersection(layer.content);
+    if (onScreen.isEmpty())
+        return;
+
+    if (!layer.area.contains(onScreen))
+    {
+        layer.area = onScreen.expanded(getWidth() / 4, getHeight() / 4).getIntersection(layer.content);
+        layer.image = {};
+        if ((juce::int64)layer.area.getWidth() * layer.area.getHeight() <= maxLayerPixels)
+        {
+            layer.image = juce::Image(juce::Image::ARGB, layer.area.getWidth(), layer.area.getHeight(), true);
+            juce::Graphics ig(layer.image);
+            if (tileGrid)
+                drawTiles(ig, -layer.area.getX(), -layer.area.getY());
+            else
+                drawScene(ig, -layer.area.getX(), -layer.area.getY());
+        }
+    }
+
+    if (layer.image.isValid())
+        g.drawImageAt(layer.image, ox + layer.area.getX(), oy + layer.area.getY());
+    else if (tileGrid)
+        drawTiles(g, ox, oy);
+    else
+        drawScene(g, ox, oy);
+}
+
+juce::Rectangle<float> MainComponent::CanvasOverlayComponent::getSceneArea() const
+{
+    int mapWidth = generalState.getProperty(juce::Identifier("mapWidth"), 64);
+    int mapHeight = generalState.getProperty(juce::Identifier("mapHeight"), 64);
+    float radiusX = randGenState.getProperty(juce::Identifier("radiusX"), 8.0f);
+    float radiusY = randGenState.getProperty(juce::Identifier("radiusY"), 8.0f);
+
+    juce::Rectangle<float> area((float)(-mapWidth / 2), (float)(-mapHeight / 2), (float)mapWidth, (float)mapHeight);
+    if (!generated)
+        area = area.getUnion({ -radiusX, -radiusY, radiusX * 2, radiusY * 2 });
+    for (const auto* vec : { &boxes, &rooms, &corridors })
+        for (const auto& box : *vec)
+            area = area.getUnion({ (float)box.x, (float)box.y, (float)box.w, (float)box.h });
+    return area;
+}
+
+juce::Rectangle<float> MainComponent::CanvasOverlayComponent::getTileArea() const
+{
+    int mapWidth = tiles.getWidth();
+    int mapHeight = tiles.getHeight();
+    return { (float)(-mapWidth / 2), (float)(-mapHeight / 2), (float)mapWidth, (float)mapHeight };
+}
+
+void MainComponent::CanvasOverlayComponent::invalidateLayers()
+{
+    sceneLayer.valid = false;
+    tileLayer.valid = false;
+    repaint();
+}
+
+void MainComponent::CanvasOverlayComponent::drawScene(juce::Graphics& g, int ox, int oy)
 {
     static const float dashes[2] = { 2.0f, 4.0f };
     static const float dashes2[2] = { 5.0f, 7.0f };
@@ -26,43 +113,48 @@ void MainComponent::CanvasOverlayComponent::paint(juce::Graphics& g)
     bool useRectRegion = randGenState.getProperty(juce::Identifier("useRectRegion"), false);
     float radiusX = randGenState.getProperty(juce::Identifier("radiusX"), 8.0f);
     float radiusY = randGenState.getProperty(juce::Identifier("radiusY"), 8.0f);
-    
-    auto b2 = getLocalBounds();
+    auto visible = getVisibleArea(g, ox, oy);
+    const bool drawLabels = scale > detailScale;
+
     if (!generated)
     {
         g.setColour(juce::Colours::grey);
-        for (int i = -mapWidth / 2; i < mapWidth / 2 + 1; i++)
+        int firstCol = juce::jmax(-mapWidth / 2, (int)std::floor(visible.getX()));
+        int lastCol = juce::jmin(mapWidth / 2, (int)std::ceil(visible.getRight()));
+        int firstRow = juce::jmax(-mapHeight / 2, (int)std::floor(visible.getY()));
+        int lastRow = juce::jmin(mapHeight / 2, (int)std::ceil(visible.getBottom()));
+        for (int i = firstCol; i <= lastCol; i++)
         {
             g.drawLine(juce::Line<float>(
-                b2.getCentreX() + i * scale + viewDx,
-                -mapHeight / 2 * scale + b2.getCentreY() + viewDy,
-                b2.getCentreX() + i * scale + viewDx,
-                mapHeight / 2 * scale + b2.getCentreY() + viewDy));
+                ox + i * scale,
+                -mapHeight / 2 * scale + oy,
+                ox + i * scale,
+                mapHeight / 2 * scale + oy));
         }
-        for (int i = -mapHeight / 2; i < mapHeight / 2 + 1; i++)
+        for (int i = firstRow; i <= lastRow; i++)
         {
             g.drawLine(juce::Line<float>(
-                -mapWidth / 2 * scale + b2.getCentreX() + viewDx,
-                b2.getCentreY() + i * scale + viewDy,
-                mapWidth / 2 * scale + b2.getCentreX() + viewDx,
-                b2.getCentreY() + i * scale + viewDy));
+                -mapWidth / 2 * scale + ox,
+                oy + i * scale,
+                mapWidth / 2 * scale + ox,
+                oy + i * scale));
         }
         g.setColour(juce::Colours::black);
         g.drawLine(juce::Line<float>(
-            b2.getCentreX() + viewDx,
-            -mapHeight / 2 * scale + b2.getCentreY() + viewDy,
-            b2.getCentreX() + viewDx,
-            mapHeight / 2 * scale + b2.getCentreY() + viewDy), 2.f);
+            ox,
+            -mapHeight / 2 * scale + oy,
+            ox,
+            mapHeight / 2 * scale + oy), 2.f);
         g.drawLine(juce::Line<float>(
-            -mapWidth / 2 * scale + b2.getCentreX() + viewDx,
-            b2.getCentreY() + viewDy,
-            mapWidth / 2 * scale + b2.getCentreX() + viewDx,
-            b2.getCentreY() + viewDy), 2.f);
+            -mapWidth / 2 * scale + ox,
+            oy,
+            mapWidth / 2 * scale + ox,
+            oy), 2.f);
         
         g.setColour(juce::Colours::white);
         auto genRegion = juce::Rectangle<float>(
-            -radiusX * scale + b2.getCentreX() + viewDx,
-            -radiusY * scale + b2.getCentreY() + viewDy,
+            -radiusX * scale + ox,
+            -radiusY * scale + oy,
             radiusX * 2 * scale,
             radiusY * 2 * scale
             );
@@ -79,9 +171,14 @@ void MainComponent::CanvasOverlayComponent::paint(juce::Graphics& g)
     int idx = 0;
     for (const auto& box : boxes)
     {
+        if (!visible.intersects({ (float)box.x, (float)box.y, (float)box.w, (float)box.h }))
+        {
+            idx++;
+            continue;
+        }
         auto rect = juce::Rectangle<float>(
-            box.x * scale + b2.getCentreX() + viewDx,
-            box.y * scale + b2.getCentreY() + viewDy,
+            box.x * scale + ox,
+            box.y * scale + oy,
             box.w * scale, box.h * scale);
 
         g.setColour(juce::Colours::lightgreen.withAlpha(0.5f));
@@ -89,30 +186,35 @@ void MainComponent::CanvasOverlayComponent::paint(juce::Graphics& g)
         g.setColour(juce::Colours::orange.withAlpha(0.5f));
         g.drawRect(rect, 3.f);
 
-        if (scale > 4)
+        if (drawLabels)
         {
             g.setColour(juce::Colours::red);
             g.fillEllipse(juce::Rectangle<float>(
-                box.cx * scale + b2.getCentreX() - 4 + viewDx,
-                box.cy * scale + b2.getCentreY() - 4 + viewDy, 8, 8));
+                box.cx * scale + ox - 4,
+                box.cy * scale + oy - 4, 8, 8));
+
+            juce::AttributedString label;
+            label.setJustification(juce::Justification::centred);
+            label.append(juce::String(idx), juce::Font(18), juce::Colours::black);
+            label.append("  w,h=" + juce::String(box.w) + ", " + juce::String(box.h), juce::Font(9), juce::Colours::black);
+            label.append("  cx,cy=" + juce::String(box.cx) + ", " + juce::String(box.cy), juce::Font(9), juce::Colours::black);
+            juce::TextLayout layout;
+            layout.createLayout(label, rect.getWidth(), rect.getHeight());
+            layout.draw(g, rect);
         }
-
-        juce::AttributedString label;
-        label.setJustification(juce::Justification::centred);
-        label.append(juce::String(idx), juce::Font(18), juce::Colours::black);
-        label.append("  w,h=" + juce::String(box.w) + ", " + juce::String(box.h), juce::Font(9), juce::Colours::black);
-        label.append("  cx,cy=" + juce::String(box.cx) + ", " + juce::String(box.cy), juce::Font(9), juce::Colours::black);
-        juce::TextLayout layout;
-        layout.createLayout(label, rect.getWidth(), rect.getHeight());
-        layout.draw(g, rect);
         idx++;
     }
     idx = 0;
     for (const auto& box : rooms)
     {
+        if (!visible.intersects({ (float)box.x, (float)box.y, (float)box.w, (float)box.h }))
+        {
+            idx++;
+            continue;
+        }
         auto rect = juce::Rectangle<float>(
-            box.x * scale + b2.getCentreX() + viewDx,
-            box.y * scale + b2.getCentreY() + viewDy,
+            box.x * scale + ox,
+            box.y * scale + oy,
             box.w * scale, box.h * scale);
 
         g.setColour(juce::Colours::skyblue.withAlpha(0.8f));
@@ -120,30 +222,35 @@ void MainComponent::CanvasOverlayComponent::paint(juce::Graphics& g)
         g.setColour(juce::Colours::orange.withAlpha(0.5f));
         g.drawRect(rect, 3.f);
 
-        if (scale > 4)
+        if (drawLabels)
         {
             g.setColour(juce::Colours::red);
             g.fillEllipse(juce::Rectangle<float>(
-                box.cx * scale + b2.getCentreX() - 4 + viewDx,
-                box.cy * scale + b2.getCentreY() - 4 + viewDy, 8, 8));
+                box.cx * scale + ox - 4,
+                box.cy * scale + oy - 4, 8, 8));
+
+            juce::AttributedString label;
+            label.setJustification(juce::Justification::centred);
+            label.append(juce::String(idx), juce::Font(18), juce::Colours::black);
+            label.append("  w,h=" + juce::String(box.w) + ", " + juce::String(box.h), juce::Font(9), juce::Colours::black);
+            label.append("  cx,cy=" + juce::String(box.cx) + ", " + juce::String(box.cy), juce::Font(9), juce::Colours::black);
+            juce::TextLayout layout;
+            layout.createLayout(label, rect.getWidth(), rect.getHeight());
+            layout.draw(g, rect);
         }
-
-        juce::AttributedString label;
-        label.setJustification(juce::Justification::centred);
-        label.append(juce::String(idx), juce::Font(18), juce::Colours::black);
-        label.append("  w,h=" + juce::String(box.w) + ", " + juce::String(box.h), juce::Font(9), juce::Colours::black);
-        label.append("  cx,cy=" + juce::String(box.cx) + ", " + juce::String(box.cy), juce::Font(9), juce::Colours::black);
-        juce::TextLayout layout;
-        layout.createLayout(label, rect.getWidth(), rect.getHeight());
-        layout.draw(g, rect);
         idx++;
     }
     idx = 0;
     for (const auto& box : corridors)
     {
+        if (!visible.intersects({ (float)box.x, (float)box.y, (float)box.w, (float)box.h }))
+        {
+            idx++;
+            continue;
+        }
         auto rect = juce::Rectangle<float>(
-            box.x * scale + b2.getCentreX() + viewDx,
-            box.y * scale + b2.getCentreY() + viewDy,
+            box.x * scale + ox,
+            box.y * scale + oy,
             box.w * scale, box.h * scale);
 
         g.setColour(juce::Colours::green.withAlpha(0.7f));
@@ -151,36 +258,44 @@ void MainComponent::CanvasOverlayComponent::paint(juce::Graphics& g)
         g.setColour(juce::Colours::orange.withAlpha(0.5f));
         g.drawRect(rect, 3.f);
 
-        if (scale > 4)
+        if (drawLabels)
         {
             g.setColour(juce::Colours::red);
             g.fillEllipse(juce::Rectangle<float>(
-                box.cx * scale + b2.getCentreX() - 4 + viewDx,
-                box.cy * scale + b2.getCentreY() - 4 + viewDy, 8, 8));
+                box.cx * scale + ox - 4,
+                box.cy * scale + oy - 4, 8, 8));
+
+            juce::AttributedString label;
+            label.setJustification(juce::Justification::centred);
+            label.append(juce::String(idx), juce::Font(18), juce::Colours::black);
+            label.append("  w,h=" + juce::String(box.w) + ", " + juce::String(box.h), juce::Font(9), juce::Colours::black);
+            label.append("  cx,cy=" + juce::String(box.cx) + ", " + juce::String(box.cy), juce::Font(9), juce::Colours::black);
+            juce::TextLayout layout;
+            layout.createLayout(label, rect.getWidth(), rect.getHeight());
+            layout.draw(g, rect);
         }
-
-        juce::AttributedString label;
-        label.setJustification(juce::Justification::centred);
-        label.append(juce::String(idx), juce::Font(18), juce::Colours::black);
-        label.append("  w,h=" + juce::String(box.w) + ", " + juce::String(box.h), juce::Font(9), juce::Colours::black);
-        label.append("  cx,cy=" + juce::String(box.cx) + ", " + juce::String(box.cy), juce::Font(9), juce::Colours::black);
-        juce::TextLayout layout;
-        layout.createLayout(label, rect.getWidth(), rect.getHeight());
-        layout.draw(g, rect);
         idx++;
     }
-    for (const auto& e : edges)
+    for (int u = 0; u < edges.getNumNodes(); u++)
     {
-        g.setColour(juce::Colours::blue);
-        double x1 = rooms[std::get<0>(e)].cx;
-        double y1 = rooms[std::get<0>(e)].cy;
-        double x2 = rooms[std::get<1>(e)].cx;
-        double y2 = rooms[std::get<1>(e)].cy;
-        g.drawDashedLine(juce::Line<float>(
-            x1 * scale + b2.getCentreX() + viewDx,
-            y1 * scale + b2.getCentreY() + viewDy,
-            x2 * scale + b2.getCentreX() + viewDx,
-            y2 * scale + b2.getCentreY() + viewDy), dashes, 2, 2.f);
+        for (int k = edges.offsets[u]; k < edges.offsets[u + 1]; k++)
+        {
+            int v = edges.neighbours[k];
+            if (v < u)
+                continue;
+            g.setColour(juce::Colours::blue);
+            double x1 = rooms[u].cx;
+            double y1 = rooms[u].cy;
+            double x2 = rooms[v].cx;
+            double y2 = rooms[v].cy;
+            if (!isSegmentVisible(visible, x1, y1, x2, y2))
+                continue;
+            g.drawDashedLine(juce::Line<float>(
+                x1 * scale + ox,
+                y1 * scale + oy,
+                x2 * scale + ox,
+                y2 * scale + oy), dashes, 2, 2.f);
+        }
     }
     for (const auto& e : mst_edges)
     {
@@ -189,62 +304,113 @@ void MainComponent::CanvasOverlayComponent::paint(juce::Graphics& g)
         double y1 = rooms[e.first].cy;
         double x2 = rooms[e.second].cx;
         double y2 = rooms[e.second].cy;
+        if (!isSegmentVisible(visible, x1, y1, x2, y2))
+            continue;
         g.drawDashedLine(juce::Line<float>(
-            x1 * scale + b2.getCentreX() + viewDx,
-            y1 * scale + b2.getCentreY() + viewDy,
-            x2 * scale + b2.getCentreX() + viewDx,
-            y2 * scale + b2.getCentreY() + viewDy), dashes2, 2, 4.f);
+            x1 * scale + ox,
+            y1 * scale + oy,
+            x2 * scale + ox,
+            y2 * scale + oy), dashes2, 2, 4.f);
     }
     for (const auto& e : lines)
     {
         g.setColour(juce::Colours::purple.brighter());
         double x1, y1, x2, y2;
         std::tie(x1, y1, x2, y2) = e;
+        if (!isSegmentVisible(visible, x1, y1, x2, y2))
+            continue;
         g.drawLine(
-            x1 * scale + b2.getCentreX() + viewDx,
-            y1 * scale + b2.getCentreY() + viewDy,
-            x2 * scale + b2.getCentreX() + viewDx,
-            y2 * scale + b2.getCentreY() + viewDy, 3.f);
+            x1 * scale + ox,
+            y1 * scale + oy,
+            x2 * scale + ox,
+            y2 * scale + oy, 3.f);
     }
+}
 
-    if (generated)
+void MainComponent::CanvasOverlayComponent::drawTiles(juce::Graphics& g, int ox, int oy)
+{
+    int mapWidth = tiles.getWidth();
+    int mapHeight = tiles.getHeight();
+    g.setColour(juce::Colours::black.withAlpha(0.6f));
+    if (scale > detailScale)
+        g.setColour(juce::Colours::white.withAlpha(0.6f));
+    g.fillRect(
+        -mapWidth / 2 * scale + ox,
+        -mapHeight / 2 * scale + oy,
+        mapWidth * scale, mapHeight * scale);
+
+    // Only the cells under the clip region are visited. When a cell is smaller
+    // than minCellPixels, blocks of cells are drawn as one rectangle coloured by
+    // their most common tile type.
+    auto visible = getVisibleArea(g, ox, oy);
+    int block = scale < minCellPixels ? (minCellPixels + scale - 1) / scale : 1;
+    int firstRow = juce::jmax(-mapHeight / 2, (int)std::floor(visible.getY()));
+    int lastRow = juce::jmin(mapHeight / 2, (int)std::ceil(visible.getBottom()));
+    int firstCol = juce::jmax(-mapWidth / 2, (int)std::floor(visible.getX()));
+    int lastCol = juce::jmin(mapWidth / 2, (int)std::ceil(visible.getRight()));
+    firstRow -= (firstRow + mapHeight / 2) % block;
+    firstCol -= (firstCol + mapWidth / 2) % block;
+
+    for (int i = firstRow; i < lastRow; i += block)
     {
-        g.setColour(juce::Colours::black.withAlpha(0.6f));
-        if (scale > 4)
-            g.setColour(juce::Colours::white.withAlpha(0.6f));
-        g.fillRect(
-            -mapWidth / 2 * scale + b2.getCentreX() + viewDx,
-            -mapHeight / 2 * scale + b2.getCentreY() + viewDy,
-            mapWidth * scale, mapHeight * scale);
-        for (int i = -mapHeight / 2; i < mapHeight / 2; i++)
+        for (int j = firstCol; j < lastCol; j += block)
         {
-            for (int j = -mapWidth / 2; j < mapWidth / 2; j++)
+            int rowEnd = juce::jmin(i + block, mapHeight / 2);
+            int colEnd = juce::jmin(j + block, mapWidth / 2);
+            int type = 0;
+            if (block == 1)
+            {
+                type = tiles.get(j + mapWidth / 2, i + mapHeight / 2);
+            }
+            else
+            {
+                int counts[4] = { 0, 0, 0, 0 };
+                for (int bi = i; bi < rowEnd; bi++)
+                    for (int bj = j; bj < colEnd; bj++)
+                        counts[tiles.get(bj + mapWidth / 2, bi + mapHeight / 2)]++;
+                for (int t = 1; t < 4; t++)
+                    if (counts[t] > 0 && counts[t] >= counts[type])
+                        type = t;
+            }
+
+            g.setColour(juce::Colours::black);
+            juce::Rectangle<float> cell(j * scale + ox, i * scale + oy, (colEnd - j) * scale, (rowEnd - i) * scale);
+            if (type > 0)
+            {
+                if (!tileColor || type == 1)
+                    g.setColour(juce::Colours::lightcyan);
+                else if (type == 2)
+                    g.setColour(juce::Colours::lightgreen);
+                else if (type == 3)
+                    g.setColour(juce::Colours::skyblue);
+                g.fillRect(cell);
+            }
+            if (scale > detailScale)
             {
-                auto type = tiles[(i + mapHeight / 2) * mapWidth + j + mapWidth / 2];
+                g.drawRect(cell, 0.5f);
                 g.setColour(juce::Colours::black);
-                juce::Rectangle<float> cell(j * scale + b2.getCentreX() + viewDx, i * scale + b2.getCentreY() + viewDy, scale, scale);
-                if (type > 0)
-                {
-                    if (!tileColor || type == 1)
-                        g.setColour(juce::Colours::lightcyan);
-                    else if (type == 2)
-                        g.setColour(juce::Colours::lightgreen);
-                    else if (type == 3)
-                        g.setColour(juce::Colours::skyblue);
-                    g.fillRect(cell);
-                }
-                if (scale > 4)
-                {
-                    g.drawRect(cell, 0.5f);
-                    g.setColour(juce::Colours::black);
-                    g.setFont(scale);
-                    g.drawText(juce::String(tiles[(i + mapHeight / 2) * mapWidth + j + mapWidth / 2]), cell, juce::Justification::centred);
-                }
+                g.setFont(scale);
+                g.drawText(juce::String(type), cell, juce::Justification::centred);
             }
         }
     }
 }
 
+juce::Rectangle<float> MainComponent::CanvasOverlayComponent::getVisibleArea(const juce::Graphics& g, int ox, int oy) const
+{
+    auto clip = g.getClipBounds().toFloat();
+    return { (clip.getX() - ox) / scale, (clip.getY() - oy) / scale, clip.getWidth() / scale, clip.getHeight() / scale };
+}
+
+bool MainComponent::CanvasOverlayComponent::isSegmentVisible(const juce::Rectangle<float>& visible, double x1, double y1, double x2, double y2)
+{
+    // Conservative: tests the segment's bounding box, padded for the stroke width.
+    auto bounds = juce::Rectangle<float>::leftTopRightBottom(
+        (float)juce::jmin(x1, x2), (float)juce::jmin(y1, y2),
+        (float)juce::jmax(x1, x2), (float)juce::jmax(y1, y2));
+    return visible.intersects(bounds.expanded(1.0f));
+}
+
 void MainComponent::CanvasOverlayComponent::resized()
 {
     repaint();
@@ -282,6 +448,85 @@ void MainComponent::CanvasOverlayComponent::mouseWheelMove(const juce::MouseEven
     repaint();
 }
 
+MainComponent::GenerationThread::GenerationThread(MainComponent& owner)
+    : juce::Thread("Dungeon generation"), owner(owner)
+{
+    engine.cancelFlag = &cancel;
+    engine.stats = &stats;
+}
+
+MainComponent::GenerationThread::~GenerationThread()
+{
+    signalThreadShouldExit();
+    cancel = true;
+    notify();
+    stopThread(5000);
+}
+
+void MainComponent::GenerationThread::request(const DungeonGenerationEngine::Parameters& params, int step)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        pendingParams = params;
+        pendingStep = step;
+        hasPending = true;
+        cancel = true;
+    }
+    notify();
+}
+
+bool MainComponent::GenerationThread::takePending(DungeonGenerationEngine::Parameters& params, int& step)
+{
+    const juce::ScopedLock sl(lock);
+    if (!hasPending)
+        return false;
+    params = pendingParams;
+    step = pendingStep;
+    hasPending = false;
+    cancel = false;
+    return true;
+}
+
+void MainComponent::GenerationThread::run()
+{
+    while (!threadShouldExit())
+    {
+        DungeonGenerationEngine::Parameters params;
+        int step;
+        if (!takePending(params, step))
+        {
+            wait(-1);
+            continue;
+        }
+
+        // An exception escaping a juce::Thread would terminate the app, so a failed
+        // run is reported and the canvas keeps the previous result.
+        std::shared_ptr<DungeonGenerationEngine::Dungeon> dungeon;
+        juce::String error;
+        try
+        {
+            dungeon = std::make_shared<DungeonGenerationEngine::Dungeon>(engine.generate(params, step, &stageCache));
+        }
+        catch (const std::exception& e)
+        {
+            error = e.what();
+        }
+        if (cancel || threadShouldExit())
+            continue;
+
+        juce::Component::SafePointer<MainComponent> safeOwner(&owner);
+        juce::MessageManager::callAsync([safeOwner, dungeon, error, stats = stats]()
+        {
+            if (safeOwner == nullptr)
+                return;
+            if (dungeon != nullptr)
+                safeOwner->applyResult(*dungeon, stats);
+            else
+                safeOwner->applyFailure(error);
+        });
+    }
+}
+
 MainComponent::CustomSliderPropertyComponent::CustomSliderPropertyComponent(const juce::Value& valueToControl,
             const juce::String& propertyName,
             double rangeMin,
@@ -297,54 +542,17 @@ MainComponent::CustomSliderPropertyComponent::CustomSliderPropertyComponent(cons
 
 MainComponent::MainComponent()
 {
-    juce::ValueTree basicTree(juce::Identifier("General"));
-    basicTree.setProperty(juce::Identifier("seed"), 0, nullptr);
-    basicTree.setProperty(juce::Identifier("maxIteration"), 1000 * 100, nullptr);
-    basicTree.setProperty(juce::Identifier("mapWidth"), 64, nullptr);
-    basicTree.setProperty(juce::Identifier("mapHeight"), 64, nullptr);
-    state.appendChild(basicTree, nullptr);
-
-    juce::ValueTree randBoxTree(juce::Identifier("Random Box Generation"));
-    randBoxTree.setProperty(juce::Identifier("useRectRegion"), false, nullptr);
-    randBoxTree.setProperty(juce::Identifier("radiusX"), 8.0f, nullptr);
-    randBoxTree.setProperty(juce::Identifier("radiusY"), 8.0f, nullptr);
-    randBoxTree.setProperty(juce::Identifier("numBox"), 100, nullptr);
-    randBoxTree.setProperty(juce::Identifier("smallBoxProb"), 0.9f, nullptr);
-    randBoxTree.setProperty(juce::Identifier("smallBoxRatioLimit"), 4.f, nullptr);
-    randBoxTree.setProperty(juce::Identifier("largeBoxRatioLimit"), 3.f, nullptr);
-    randBoxTree.setProperty(juce::Identifier("largeBoxRadiusMul"), 0.65f, nullptr);
-    randBoxTree.setProperty(juce::Identifier("smallBoxUseNormalDist"), false, nullptr);
-    randBoxTree.setProperty(juce::Identifier("smallBoxDistUnifA"), 1.f, nullptr);
-    randBoxTree.setProperty(juce::Identifier("smallBoxDistUnifB"), 4.f, nullptr);
-    randBoxTree.setProperty(juce::Identifier("smallBoxDistMu"), 2.f, nullptr);
-    randBoxTree.setProperty(juce::Identifier("smallBoxDistSigma"), 2.f, nullptr);
-    randBoxTree.setProperty(juce::Identifier("largeBoxUseNormalDist"), false, nullptr);
-    randBoxTree.setProperty(juce::Identifier("largeBoxDistUnifA"), 8.f, nullptr);
-    randBoxTree.setProperty(juce::Identifier("largeBoxDistUnifB"), 12.f, nullptr);
-    randBoxTree.setProperty(juce::Identifier("largeBoxDistMu"), 8.f, nullptr);
-    randBoxTree.setProperty(juce::Identifier("largeBoxDistSigma"), 2.f, nullptr);
-    state.appendChild(randBoxTree, nullptr);
-
-    juce::ValueTree randBoxSelect(juce::Identifier("Random Box Selection"));
-    randBoxSelect.setProperty(juce::Identifier("numRooms"), 12, nullptr);
-    randBoxSelect.setProperty(juce::Identifier("allowTouching"), false , nullptr);
-    state.appendChild(randBoxSelect, nullptr);
-
-    juce::ValueTree otherTree(juce::Identifier("Line Connection"));
-    otherTree.setProperty(juce::Identifier("addBackProb"), 0.1f, nullptr);
-    otherTree.setProperty(juce::Identifier("overlapPadding"), 3, nullptr);
-    otherTree.setProperty(juce::Identifier("addBothDirection"), false, nullptr);
-    otherTree.setProperty(juce::Identifier("firstHorizontalProb"), 0.5f, nullptr);
-    otherTree.setProperty(juce::Identifier("maxRoomSize"), 12, nullptr);
-    state.appendChild(otherTree, nullptr);
+    state.copyPropertiesAndChildrenFrom(DungeonGenerationEngine::Parameters().toValueTree(), nullptr);
 
     state.addListener(this);
     
     canvasComp = std::make_unique<CanvasOverlayComponent>(this, state);
+    generationThread.startThread();
     
     std::for_each(stepBtns.begin(), stepBtns.end(), [this](juce::Component* c) { addAndMakeVisible(c); });
 
     addAndMakeVisible(propertyPanel);
+    addAndMakeVisible(statsView);
     addAndMakeVisible(canvasComp.get());
     addAndMakeVisible(layoutResizer);
     
@@ -356,6 +564,11 @@ MainComponent::MainComponent()
     layout.setItemLayout(1, 5, 5, 5);
     layout.setItemLayout(2, -0.5, -0.9, -0.8);
 
+    statsView.setMultiLine(true);
+    statsView.setReadOnly(true);
+    statsView.setCaretVisible(false);
+    statsView.setFont(juce::Font(juce::Font::getDefaultMonospacedFontName(), 12.0f, juce::Font::plain));
+
     setSize(1200, 800);
 
     for (auto child : state)
@@ -398,7 +611,7 @@ MainComponent::MainComponent()
     btnTileColor.setToggleState(true, false);
     btnTileColor.onClick = [this]() {
         canvasComp->tileColor = !canvasComp->tileColor;
-        repaint();
+        canvasComp->invalidateLayers();
     };
 
 }
@@ -448,6 +661,7 @@ void MainComponent::paint (juce::Graphics& g)
     auto propertyBounds = panelDummy.getBounds().reduced(5);
     btnPipeline.setBounds(propertyBounds.removeFromTop(50));
     propertyBounds.removeFromTop(5);
+    statsView.setBounds(propertyBounds.removeFromBottom(190));
     propertyPanel.setBounds(propertyBounds.reduced(0, 5));
 
     auto canvasBounds = canvasDummy.getBounds();
@@ -467,125 +681,63 @@ void MainComponent::resized()
 
 void MainComponent::runPipeline(int step)
 {
-    canvasComp->boxes.clear();
-    canvasComp->rooms.clear();
-    canvasComp->corridors.clear();
-    canvasComp->edges.clear();
-    canvasComp->mst_edges.clear();
-    canvasComp->lines.clear();
-    canvasComp->tiles.clear();
-    canvasComp->generated = false;
-
-    int s = 0;
-    if (s <= step)
-    {
-        const auto& generalParams = state.getChildWithName(juce::Identifier("General"));
-        const auto& boxGenParams = state.getChildWithName(juce::Identifier("Random Box Generation"));
-        unsigned int seed = (int)generalParams.getProperty(juce::Identifier("seed"), 42);
-        unsigned int maxIteration = (int)generalParams.getProperty(juce::Identifier("maxIteration"), 100000);
-        bool useRectRegion = boxGenParams.getProperty(juce::Identifier("useRectRegion"), false);
-        unsigned int radiusX = (int)boxGenParams.getProperty(juce::Identifier("radiusX"), 32);
-        unsigned int radiusY = (int)boxGenParams.getProperty(juce::Identifier("radiusY"), 32);
-        unsigned int numBox = (int)boxGenParams.getProperty(juce::Identifier("numBox"), 100);
-        float smallBoxProb = boxGenParams.getProperty(juce::Identifier("smallBoxProb"), 0.9f);
-        bool smallBoxUseNormalDist = boxGenParams.getProperty(juce::Identifier("smallBoxUseNormalDist"), false);
-        float smallBoxDistUnifA = boxGenParams.getProperty(juce::Identifier("smallBoxDistUnifA"), 1.f);
-        float smallBoxDistUnifB = boxGenParams.getProperty(juce::Identifier("smallBoxDistUnifB"), 4.f);
-        float smallBoxDistMu = boxGenParams.getProperty(juce::Identifier("smallBoxDistMu"), 2.f);
-        float smallBoxDistSigma = boxGenParams.getProperty(juce::Identifier("smallBoxDistSigma"), 2.f);
-        float smallBoxRatioLimit = boxGenParams.getProperty(juce::Identifier("smallBoxRatioLimit"), 4.f);
-        bool largeBoxUseNormalDist = boxGenParams.getProperty(juce::Identifier("largeBoxUseNormalDist"), false);
-        float largeBoxDistUnifA = boxGenParams.getProperty(juce::Identifier("largeBoxDistUnifA"), 8.f);
-        float largeBoxDistUnifB = boxGenParams.getProperty(juce::Identifier("largeBoxDistUnifB"), 12.f);
-        float largeBoxDistMu = boxGenParams.getProperty(juce::Identifier("largeBoxDistMu"), 10.f);
-        float largeBoxDistSigma = boxGenParams.getProperty(juce::Identifier("largeBoxDistSigma"), 2.f);
-        float largeBoxRatioLimit = boxGenParams.getProperty(juce::Identifier("largeBoxRatioLimit"), 3.f);
-        float largeBoxRadiusMultiplier = boxGenParams.getProperty(juce::Identifier("largeBoxRadiusMultiplier"), 0.65f);
-        canvasComp->boxes = engine.randBox(
-            seed, useRectRegion, radiusX, radiusY,
-            numBox, maxIteration,
-            smallBoxProb, smallBoxUseNormalDist,
-            smallBoxUseNormalDist ? smallBoxDistMu : smallBoxDistUnifA, smallBoxUseNormalDist ? smallBoxDistSigma : smallBoxDistUnifB,
-            smallBoxRatioLimit,
-            largeBoxUseNormalDist,
-            largeBoxUseNormalDist ? largeBoxDistMu : largeBoxDistUnifA, largeBoxUseNormalDist ? largeBoxDistSigma : largeBoxDistUnifB,
-            largeBoxRatioLimit, largeBoxRadiusMultiplier);
-        s++;
-    }
-    if (s <= step)
-    {
-        canvasComp->boxes = engine.separateBox(canvasComp->boxes);
-        s++;
-    }
-    if (s <= step)
-    {
-        const auto& generalParams = state.getChildWithName(juce::Identifier("General"));
-        unsigned int mapWidth = (int)generalParams.getProperty(juce::Identifier("mapWidth"), 64);
-        unsigned int mapHeight = (int)generalParams.getProperty(juce::Identifier("mapHeight"), 64);
-        canvasComp->boxes = engine.centerAndCropBox(canvasComp->boxes, mapWidth, mapHeight);
-        s++;
-    }
-    if (s <= step)
-    {
-        const auto& selectionParams = state.getChildWithName(juce::Identifier("Random Box Selection"));
-        unsigned int numRooms = (int)selectionParams.getProperty(juce::Identifier("numRooms"), 64);
-        bool allowTouching = selectionParams.getProperty(juce::Identifier("allowTouching"), false);
-        auto ret = engine.randSelect(canvasComp->boxes, numRooms, allowTouching);
-        canvasComp->boxes = ret.first;
-        canvasComp->rooms = ret.second;
-        s++;
-    }
-    if (s <= step)
-    {
-        canvasComp->edges = engine.triangulate(canvasComp->rooms);
-        s++;
-    }
-    if (s <= step)
-    {
-        const auto& selectionParams = state.getChildWithName(juce::Identifier("Random Box Selection"));
-        unsigned int numRooms = (int)selectionParams.getProperty(juce::Identifier("numRooms"), 64);
-        canvasComp->mst_edges = engine.mst(canvasComp->edges);
-        s++;
-    }
-    if (s <= step)
-    {
-        const auto& generalParams = state.getChildWithName(juce::Identifier("General"));
-        const auto& lineParams = state.getChildWithName(juce::Identifier("Line Connection"));
-        unsigned int seed = (int)generalParams.getProperty(juce::Identifier("seed"), 42);
-        float addBackProb = lineParams.getProperty(juce::Identifier("addBackProb"), 0.1f);
-        canvasComp->mst_edges = engine.addSomeEdgesBack(seed, canvasComp->edges, canvasComp->mst_edges, addBackProb);
-        s++;
-    }
-    if (s <= step)
-    {
-        const auto& generalParams = state.getChildWithName(juce::Identifier("General"));
-        const auto& lineParams = state.getChildWithName(juce::Identifier("Line Connection"));
-        unsigned int seed = (int)generalParams.getProperty(juce::Identifier("seed"), 42);
-        unsigned int overlapPadding = (int)lineParams.getProperty(juce::Identifier("overlapPadding"), 3);
-        bool addBothDirection = lineParams.getProperty(juce::Identifier("addBothDirection"), false);
-        float firstHorizontalProb = lineParams.getProperty(juce::Identifier("firstHorizontalProb"), 0.5f);
-        canvasComp->lines = engine.lineConnect(seed, canvasComp->rooms, canvasComp->mst_edges, overlapPadding, addBothDirection, firstHorizontalProb);
-        s++;
-    }
-    if (s <= step)
-    {
-        const auto& lineParams = state.getChildWithName(juce::Identifier("Line Connection"));
-        unsigned int maxRoomSize = (int)lineParams.getProperty(juce::Identifier("maxRoomSize"), 12);
-        auto ret = engine.selectCorridors(canvasComp->boxes, canvasComp->lines, maxRoomSize);
-        canvasComp->boxes = ret.first;
-        canvasComp->corridors = ret.second;
-        s++;
-    }
-    if (s <= step)
-    {
-        const auto& generalParams = state.getChildWithName(juce::Identifier("General"));
-        unsigned int mapWidth = (int)generalParams.getProperty(juce::Identifier("mapWidth"), 64);
-        unsigned int mapHeight = (int)generalParams.getProperty(juce::Identifier("mapHeight"), 64);
-        canvasComp->tiles = engine.tiling(canvasComp->rooms, canvasComp->corridors, canvasComp->lines, mapWidth, mapHeight);
-        canvasComp->generated = true;
-        s++;
-    }
-
+    // Generation runs on the worker; rapid edits cancel and replace each other and
+    // the canvas only changes when a finished result arrives on the message thread.
+    generationThread.request(DungeonGenerationEngine::Parameters::fromValueTree(state), step);
     lastStep = step;
     repaint();
-}
\ No newline at end of file
+}
+
+void MainComponent::applyResult(DungeonGenerationEngine::Dungeon& dungeon, const DungeonGenerationEngine::Stats& stats)
+{
+    statsView.setText(formatStats(stats), false);
+
+    canvasComp->boxes = std::move(dungeon.boxes);
+    canvasComp->rooms = std::move(dungeon.rooms);
+    canvasComp->corridors = std::move(dungeon.corridors);
+    canvasComp->edges = std::move(dungeon.edges);
+    canvasComp->mst_edges = std::move(dungeon.mst_edges);
+    canvasComp->lines = std::move(dungeon.lines);
+    canvasComp->tiles = std::move(dungeon.tiles);
+    canvasComp->generated = dungeon.generated;
+    canvasComp->invalidateLayers();
+}
+
+void MainComponent::applyFailure(const juce::String& error)
+{
+    statsView.setText("Generation failed: " + error + "\n", false);
+}
+
+juce::String MainComponent::formatStats(const DungeonGenerationEngine::Stats& stats)
+{
+    juce::String text;
+    double total = 0.0;
+    for (int i = 0; i < DungeonGenerationEngine::numSteps; i++)
+    {
+        text << juce::String(DungeonGenerationEngine::stageNames[i]).paddedRight(' ', 18);
+        if (stats.stageRan[i])
+        {
+            text << juce::String(stats.stageMs[i], 3) << " ms\n";
+            total += stats.stageMs[i];
+        }
+        else if (stats.stageCached[i])
+        {
+            text << "cached\n";
+        }
+        else
+        {
+            text << "not run\n";
+        }
+    }
+    text << juce::String("total").paddedRight(' ', 18) << juce::String(total, 3) << " ms\n\n";
+    text << "candidates " << (juce::int64)stats.candidates
+        << ", ratio rejects " << (juce::int64)stats.rejectedRatio
+        << ", duplicates " << (juce::int64)stats.rejectedDuplicate << "\n";
+    text << "overlap tests " << (juce::int64)stats.overlapTests
+        << ", moves " << (juce::int64)stats.moveAwayCalls << "\n";
+    text << "separation rounds " << stats.separationRounds
+        << ", residual overlaps " << (juce::int64)stats.residualOverlaps << "\n";
+    text << "triangles " << (juce::int64)stats.triangles
+        << ", tiles written " << (juce::int64)stats.tilesWritten;
+    return text;
+}
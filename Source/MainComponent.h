@@ -20,9 +20,36 @@ class MainComponent  : public juce::Component, public juce::ValueTree::Listener
         void mouseDown(const juce::MouseEvent& e) override;
         void mouseDrag(const juce::MouseEvent& e) override;
         void mouseWheelMove(const juce::MouseEvent& e, const juce::MouseWheelDetails& wheel) override;
+
+        // Drops the cached layers; call whenever the displayed result changes.
+        void invalidateLayers();
         
     private:
-        using WeightedEdgeSet = std::set<std::tuple<int, int, double>, DungeonGenerationEngine::CustomTupleComp>;
+        struct CachedLayer
+        {
+            // Pixel rectangles relative to the map origin at this scale: content
+            // is everything the layer could draw, area the part held in image.
+            juce::Image image;
+            juce::Rectangle<int> content;
+            juce::Rectangle<int> area;
+            int scale{ 0 };
+            bool valid{ false };
+        };
+
+        void paintLayer(juce::Graphics& g, CachedLayer& layer, int ox, int oy, bool tileGrid);
+        void drawScene(juce::Graphics& g, int ox, int oy);
+        void drawTiles(juce::Graphics& g, int ox, int oy);
+        juce::Rectangle<float> getSceneArea() const;
+        juce::Rectangle<float> getTileArea() const;
+        juce::Rectangle<float> getVisibleArea(const juce::Graphics& g, int ox, int oy) const;
+        static bool isSegmentVisible(const juce::Rectangle<float>& visible, double x1, double y1, double x2, double y2);
+
+        // Zoom levels (pixels per tile) at which detail is dropped: labels and
+        // cell outlines need more than detailScale, single cells need at least
+        // minCellPixels or they are merged into blocks.
+        static constexpr int detailScale = 4;
+        static constexpr int minCellPixels = 3;
+
         using EdgeSet = std::set<std::pair<int, int>>;
         using RoomBoxVec = std::vector<DungeonGenerationEngine::RoomBox>;
         using LineSet = std::set<std::tuple<double, double, double, double>>;
@@ -37,13 +64,14 @@ class MainComponent  : public juce::Component, public juce::ValueTree::Listener
         RoomBoxVec boxes;
         RoomBoxVec rooms;
         RoomBoxVec corridors;
-        WeightedEdgeSet edges;
+        DungeonGenerationEngine::EdgeGraph edges;
         EdgeSet mst_edges;
         LineSet lines;
-        std::vector<int> tiles;
+        DungeonGenerationEngine::TileGrid tiles;
         bool generated{ false };
 
         bool tileColor{ true };
+        CachedLayer sceneLayer, tileLayer;
 
         float fScale{ 10.f };
         int scale{ 10 };
@@ -52,6 +80,31 @@ class MainComponent  : public juce::Component, public juce::ValueTree::Listener
         int prevMouseX, prevMouseY;
     };
 
+    class GenerationThread : public juce::Thread
+    {
+    public:
+        GenerationThread(MainComponent& owner);
+        ~GenerationThread() override;
+
+        // Supersedes any queued or running request; only the latest one is published.
+        void request(const DungeonGenerationEngine::Parameters& params, int step);
+        void run() override;
+
+    private:
+        bool takePending(DungeonGenerationEngine::Parameters& params, int& step);
+
+        MainComponent& owner;
+        DungeonGenerationEngine engine;
+        DungeonGenerationEngine::StageCache stageCache;
+        DungeonGenerationEngine::Stats stats;
+        std::atomic<bool> cancel{ false };
+
+        juce::CriticalSection lock;
+        DungeonGenerationEngine::Parameters pendingParams;
+        int pendingStep = -1;
+        bool hasPending = false;
+    };
+
     class CustomSliderPropertyComponent : public juce::SliderPropertyComponent
     {
     public:
@@ -78,6 +131,9 @@ public:
 
     //==============================================================================
     void runPipeline(int step);
+    void applyResult(DungeonGenerationEngine::Dungeon& dungeon, const DungeonGenerationEngine::Stats& stats);
+    void applyFailure(const juce::String& error);
+    static juce::String formatStats(const DungeonGenerationEngine::Stats& stats);
 
 private:
     //==============================================================================
@@ -93,11 +149,12 @@ private:
 
     juce::ToggleButton btnTileColor{ "ColorTypes" };
 
-    DungeonGenerationEngine engine;
+    GenerationThread generationThread{ *this };
 
     juce::ValueTree state{ "ROOT" };
     
     juce::PropertyPanel propertyPanel{ "Generation Parameters" };
+    juce::TextEditor statsView;
     std::unique_ptr<CanvasOverlayComponent> canvasComp;
 
     juce::StretchableLayoutManager layout;
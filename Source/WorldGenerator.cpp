@@ -0,0 +1,232 @@
+/*
+  ==============================================================================
+
+    WorldGenerator.cpp
+
+  ==============================================================================
+*/
+
+#include "WorldGenerator.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+    // Streams of the world layer, numbered above the engine's RandomStreamId
+    // values so they never share a key with a pipeline stage.
+    enum class WorldStreamId : std::uint32_t
+    {
+        chunkSeed = 0x100,
+        southPortals = 0x101, // edge below a chunk
+        eastPortals = 0x102   // edge right of a chunk
+    };
+
+    DungeonGenerationEngine::RandomStream makeStream(unsigned int worldSeed, WorldStreamId stream, std::uint64_t index)
+    {
+        return DungeonGenerationEngine::RandomStream(worldSeed, (DungeonGenerationEngine::RandomStreamId)stream, index);
+    }
+
+    // Counter index naming a chunk, or the edges below and right of it.
+    std::uint64_t chunkIndex(int chunkX, int chunkY)
+    {
+        return ((std::uint64_t)(std::uint32_t)chunkX << 32) | (std::uint32_t)chunkY;
+    }
+
+    // The pipeline steps the portal corridors are added in front of.
+    constexpr int selectCorridorsStep = 8;
+    constexpr int tilingStep = 9;
+}
+
+//==============================================================================
+WorldGenerator::WorldGenerator(const DungeonGenerationEngine::Parameters& params, int chunkSize, int portalsPerEdge)
+    : params(params), chunkSize(std::max(4, chunkSize)), portalsPerEdge(std::max(0, portalsPerEdge))
+{
+    jassert(chunkSize >= 4);
+    this->params.mapWidth = (unsigned int)this->chunkSize;
+    this->params.mapHeight = (unsigned int)this->chunkSize;
+}
+
+unsigned int WorldGenerator::getChunkSeed(unsigned int worldSeed, int chunkX, int chunkY)
+{
+    auto random = makeStream(worldSeed, WorldStreamId::chunkSeed, chunkIndex(chunkX, chunkY));
+    return random.nextUInt32();
+}
+
+std::vector<int> WorldGenerator::getEdgePortals(int chunkX, int chunkY, bool east) const
+{
+    auto random = makeStream(params.seed, east ? WorldStreamId::eastPortals : WorldStreamId::southPortals, chunkIndex(chunkX, chunkY));
+
+    // Kept away from the corners, where a corridor would run along the edge.
+    const int margin = chunkSize / 8;
+    std::vector<int> portals;
+    portals.reserve((size_t)portalsPerEdge);
+    for (int i = 0; i < portalsPerEdge; i++)
+        portals.push_back(random.nextInt(margin, chunkSize - 2 - margin));
+    std::sort(portals.begin(), portals.end());
+    portals.erase(std::unique(portals.begin(), portals.end()), portals.end());
+    return portals;
+}
+
+std::vector<int> WorldGenerator::getPortals(int chunkX, int chunkY, Side side) const
+{
+    switch (side)
+    {
+    case Side::north:
+        return getEdgePortals(chunkX, chunkY - 1, false);
+    case Side::south:
+        return getEdgePortals(chunkX, chunkY, false);
+    case Side::west:
+        return getEdgePortals(chunkX - 1, chunkY, true);
+    case Side::east:
+        return getEdgePortals(chunkX, chunkY, true);
+    }
+    return {};
+}
+
+//==============================================================================
+WorldGenerator::Chunk WorldGenerator::generateChunk(int chunkX, int chunkY, DungeonGenerationEngine::GenerationWorkspace* workspace) const
+{
+    Chunk chunk;
+    generateChunk(chunkX, chunkY, chunk, workspace);
+    return chunk;
+}
+
+void WorldGenerator::generateChunk(int chunkX, int chunkY, Chunk& chunk, DungeonGenerationEngine::GenerationWorkspace* workspace) const
+{
+    // Chunks are small; the parallelism comes from generating several at once.
+    DungeonGenerationEngine engine;
+    engine.numThreads = 1;
+    engine.workspace = workspace;
+
+    auto p = params;
+    p.seed = getChunkSeed(params.seed, chunkX, chunkY);
+    chunk.chunkX = chunkX;
+    chunk.chunkY = chunkY;
+    for (int s = 0; s < 4; s++)
+        chunk.portals[s] = getPortals(chunkX, chunkY, (Side)s);
+    auto& d = chunk.dungeon;
+    engine.generate(p, d, selectCorridorsStep - 1);
+
+    // Engine coordinates are centred: tile t is at t - chunkSize / 2, so the
+    // lines of portal p run along p + 1 - chunkSize / 2 and cover tiles p and
+    // p + 1, and the near and far edges are at -(chunkSize / 2) and
+    // chunkSize - chunkSize / 2.
+    const double nearEdge = -(chunkSize / 2);
+    const double farEdge = chunkSize - chunkSize / 2;
+    auto addLine = [&](double x1, double y1, double x2, double y2)
+    {
+        if (x1 == x2 && y1 == y2)
+            return;
+        std::tuple<double, double, double, double> line{ x1, y1, x2, y2 };
+        if (workspace != nullptr)
+            workspace->insert(d.lines, line);
+        else
+            d.lines.insert(line);
+    };
+
+    for (int s = 0; s < 4; s++)
+    {
+        const auto side = (Side)s;
+        const bool horizontalEdge = side == Side::north || side == Side::south;
+        const double edge = (side == Side::north || side == Side::west) ? nearEdge : farEdge;
+
+        for (int portal : chunk.portals[s])
+        {
+            const double along = portal + 1 - chunkSize / 2;
+            const double px = horizontalEdge ? along : edge;
+            const double py = horizontalEdge ? edge : along;
+
+            // Straight in from the edge, then across to the nearest room's
+            // centre (the chunk centre if it has no rooms).
+            double tx = 0.0, ty = 0.0;
+            double best = -1.0;
+            for (const auto& room : d.rooms)
+            {
+                double dist = std::abs(room.cx - px) + std::abs(room.cy - py);
+                if (best < 0.0 || dist < best)
+                {
+                    best = dist;
+                    tx = room.cx;
+                    ty = room.cy;
+                }
+            }
+
+            if (horizontalEdge)
+            {
+                addLine(px, py, px, ty);
+                addLine(px, ty, tx, ty);
+            }
+            else
+            {
+                addLine(px, py, tx, py);
+                addLine(tx, py, tx, ty);
+            }
+        }
+    }
+
+    engine.runStep(selectCorridorsStep, p, d);
+    engine.runStep(tilingStep, p, d);
+}
+
+void WorldGenerator::generateRegion(int chunkX0, int chunkY0, int chunkX1, int chunkY1, int numThreads,
+    const std::function<void(const Chunk& chunk)>& callback) const
+{
+    const int width = std::max(0, chunkX1 - chunkX0);
+    const int numChunks = width * std::max(0, chunkY1 - chunkY0);
+    if (numThreads <= 0)
+        numThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+    numThreads = std::max(1, std::min(numThreads, numChunks));
+
+    // Nothing may escape a worker thread: a chunk that fails is handed to the
+    // callback with its error set, and an exception from the callback stops the
+    // remaining work and is rethrown here once every worker has finished.
+    std::atomic<int> next{ 0 };
+    std::exception_ptr callbackError;
+    std::mutex callbackErrorLock;
+    auto worker = [&]()
+    {
+        DungeonGenerationEngine::GenerationWorkspace workspace;
+        Chunk chunk;
+        for (int i = next++; i < numChunks; i = next++)
+        {
+            chunk.error.clear();
+            try
+            {
+                generateChunk(chunkX0 + i % width, chunkY0 + i / width, chunk, &workspace);
+            }
+            catch (const std::exception& e)
+            {
+                chunk.error = e.what();
+                // The workspace may hold half-built state; start the next chunk afresh.
+                workspace = DungeonGenerationEngine::GenerationWorkspace();
+                chunk.dungeon = DungeonGenerationEngine::Dungeon();
+            }
+
+            try
+            {
+                callback(chunk);
+            }
+            catch (...)
+            {
+                const std::lock_guard<std::mutex> lock(callbackErrorLock);
+                if (callbackError == nullptr)
+                    callbackError = std::current_exception();
+                next = numChunks;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve((size_t)numThreads - 1);
+    for (int t = 1; t < numThreads; t++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads)
+        t.join();
+    if (callbackError != nullptr)
+        std::rethrow_exception(callbackError);
+}
@@ -0,0 +1,90 @@
+/*
+  ==============================================================================
+
+    WorldGenerator.h
+
+    Unbounded dungeon made of square chunks, generated lazily as they are
+    needed. Each chunk runs the engine's pipeline on its own map with a seed
+    derived from the world seed and its chunk coordinates, and is joined to its
+    four neighbours through portals on the edges they share. A portal's
+    position is a hash of the world seed and the edge, so both chunks agree on
+    it without either looking at the other, and each runs a corridor from the
+    portal to its nearest room. A chunk therefore depends only on the
+    parameters and its coordinates, and costs O(chunk) time and memory to
+    generate, in any order or in parallel.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <array>
+#include <functional>
+#include <string>
+#include <vector>
+#include "DungeonGenerationEngine.h"
+
+struct WorldGenerator
+{
+    // Chunk (x, y) covers world tiles [x * chunkSize, (x + 1) * chunkSize) on
+    // each axis; y grows downwards, as in a TileGrid.
+    enum class Side
+    {
+        north = 0, // towards chunk (x, y - 1)
+        south = 1,
+        west = 2,  // towards chunk (x - 1, y)
+        east = 3
+    };
+
+    struct Chunk
+    {
+        int chunkX = 0;
+        int chunkY = 0;
+        // Rooms, corridors and lines are centred on the chunk, as the engine
+        // leaves them; tiles is the chunkSize x chunkSize window of the world.
+        DungeonGenerationEngine::Dungeon dungeon;
+        // Per Side, the portals on that edge in ascending order. Portal p opens
+        // tiles p and p + 1 along the edge (counted from the chunk's top-left
+        // corner); the neighbour across the edge has the same list.
+        std::array<std::vector<int>, 4> portals;
+        // Set by generateRegion when the chunk could not be generated; the
+        // dungeon is then empty.
+        std::string error;
+    };
+
+    // params.seed is the world seed; mapWidth and mapHeight are replaced by
+    // chunkSize, which must be at least 4. Every chunk edge gets portalsPerEdge
+    // portals (fewer if two land on the same tile).
+    WorldGenerator(const DungeonGenerationEngine::Parameters& params, int chunkSize, int portalsPerEdge = 1);
+
+    const DungeonGenerationEngine::Parameters& getParameters() const { return params; }
+    int getChunkSize() const { return chunkSize; }
+
+    static unsigned int getChunkSeed(unsigned int worldSeed, int chunkX, int chunkY);
+    std::vector<int> getPortals(int chunkX, int chunkY, Side side) const;
+
+    // Thread-safe: every call uses an engine of its own. The workspace, if
+    // given, must not be shared with a concurrent call. Throws what the
+    // pipeline throws.
+    Chunk generateChunk(int chunkX, int chunkY, DungeonGenerationEngine::GenerationWorkspace* workspace = nullptr) const;
+    // Regenerates into an existing chunk, reusing its containers.
+    void generateChunk(int chunkX, int chunkY, Chunk& chunk, DungeonGenerationEngine::GenerationWorkspace* workspace = nullptr) const;
+
+    // Generates the chunks in [chunkX0, chunkX1) x [chunkY0, chunkY1) on
+    // numThreads threads (0 uses every hardware thread), each with its own
+    // engine and workspace. callback is called once per chunk, from the worker
+    // that built it and in no particular order, and must not keep the reference.
+    // A chunk that fails still reaches callback, with Chunk::error set. If
+    // callback throws, the remaining chunks are skipped and the first exception
+    // is rethrown once the workers have stopped.
+    void generateRegion(int chunkX0, int chunkY0, int chunkX1, int chunkY1, int numThreads,
+        const std::function<void(const Chunk& chunk)>& callback) const;
+
+private:
+    // Portals on the south edge of (chunkX, chunkY) or, when east, its east edge.
+    std::vector<int> getEdgePortals(int chunkX, int chunkY, bool east) const;
+
+    DungeonGenerationEngine::Parameters params;
+    int chunkSize;
+    int portalsPerEdge;
+};
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <exception>
 #include <iostream>
 #include <limits>
@@ -149,6 +150,46 @@ namespace delaunator {
             ap * (ex * fy - ey * fx)) < 0.0;
     }
 
+    // Exact forms of orient and in_circle for points on an integer lattice. With
+    // every coordinate difference at most MAX_EXACT_SPAN each in_circle term is
+    // below 4 * 2^56, so no intermediate overflows int64.
+    constexpr std::int64_t MAX_EXACT_SPAN = std::int64_t(1) << 14;
+
+    inline bool orient_exact(
+        const std::int64_t px,
+        const std::int64_t py,
+        const std::int64_t qx,
+        const std::int64_t qy,
+        const std::int64_t rx,
+        const std::int64_t ry) {
+        return (qy - py) * (rx - qx) - (qx - px) * (ry - qy) < 0;
+    }
+
+    inline bool in_circle_exact(
+        const std::int64_t ax,
+        const std::int64_t ay,
+        const std::int64_t bx,
+        const std::int64_t by,
+        const std::int64_t cx,
+        const std::int64_t cy,
+        const std::int64_t px,
+        const std::int64_t py) {
+        const std::int64_t dx = ax - px;
+        const std::int64_t dy = ay - py;
+        const std::int64_t ex = bx - px;
+        const std::int64_t ey = by - py;
+        const std::int64_t fx = cx - px;
+        const std::int64_t fy = cy - py;
+
+        const std::int64_t ap = dx * dx + dy * dy;
+        const std::int64_t bp = ex * ex + ey * ey;
+        const std::int64_t cp = fx * fx + fy * fy;
+
+        return (dx * (ey * cp - bp * fy) -
+            dy * (ex * cp - bp * fx) +
+            ap * (ex * fy - ey * fx)) < 0;
+    }
+
     constexpr double EPSILON = std::numeric_limits<double>::epsilon();
     constexpr std::size_t INVALID_INDEX = std::numeric_limits<std::size_t>::max();
 
@@ -176,26 +217,46 @@ namespace delaunator {
     class Delaunator {
 
     public:
-        std::vector<double> const& coords;
         std::vector<std::size_t> triangles;
         std::vector<std::size_t> halfedges;
         std::vector<std::size_t> hull_prev;
         std::vector<std::size_t> hull_next;
         std::vector<std::size_t> hull_tri;
-        std::size_t hull_start;
+        std::size_t hull_start = 0;
 
+        Delaunator() = default;
         Delaunator(std::vector<double> const& in_coords);
 
+        // Triangulates in_coords, reusing the buffers of the previous run. The
+        // results stay valid until the next call; in_coords must outlive them.
+        void update(std::vector<double> const& in_coords);
+
+        std::vector<double> const& get_coords() const { return *m_coords; }
         double get_hull_area();
 
+        // True when the last update ran on exact integer predicates: every
+        // coordinate was a multiple of 1/2 and the points spanned at most
+        // MAX_EXACT_SPAN / 2 on either axis. Otherwise the double predicates
+        // were used.
+        bool is_exact() const { return m_exact; }
+
     private:
+        std::vector<double> const* m_coords = nullptr;
+        std::vector<std::int64_t> m_lattice;
+        bool m_exact = false;
+        std::vector<std::size_t> m_ids;
+        std::vector<double> m_hull_area;
+        std::vector<double> m_line_keys;
         std::vector<std::size_t> m_hash;
-        double m_center_x;
-        double m_center_y;
-        std::size_t m_hash_size;
+        double m_center_x = 0.0;
+        double m_center_y = 0.0;
+        std::size_t m_hash_size = 0;
         std::vector<std::size_t> m_edge_stack;
 
         std::size_t legalize(std::size_t a);
+        void collinear_hull(std::size_t i0);
+        bool orient_ids(std::size_t p, std::size_t q, std::size_t r) const;
+        bool in_circle_ids(std::size_t a, std::size_t b, std::size_t c, std::size_t p) const;
         std::size_t hash_key(double x, double y) const;
         std::size_t add_triangle(
             std::size_t i0,
@@ -207,26 +268,23 @@ namespace delaunator {
         void link(std::size_t a, std::size_t b);
     };
 
-    Delaunator::Delaunator(std::vector<double> const& in_coords)
-        : coords(in_coords),
-        triangles(),
-        halfedges(),
-        hull_prev(),
-        hull_next(),
-        hull_tri(),
-        hull_start(),
-        m_hash(),
-        m_center_x(),
-        m_center_y(),
-        m_hash_size(),
-        m_edge_stack() {
+    inline Delaunator::Delaunator(std::vector<double> const& in_coords) {
+        update(in_coords);
+    }
+
+    inline void Delaunator::update(std::vector<double> const& in_coords) {
+        m_coords = &in_coords;
+        std::vector<double> const& coords = in_coords;
+        triangles.clear();
+        halfedges.clear();
         std::size_t n = coords.size() >> 1;
 
         double max_x = std::numeric_limits<double>::min();
         double max_y = std::numeric_limits<double>::min();
         double min_x = std::numeric_limits<double>::max();
         double min_y = std::numeric_limits<double>::max();
-        std::vector<std::size_t> ids;
+        std::vector<std::size_t>& ids = m_ids;
+        ids.clear();
         ids.reserve(n);
 
         for (std::size_t i = 0; i < n; i++) {
@@ -240,6 +298,18 @@ namespace delaunator {
 
             ids.push_back(i);
         }
+        // Points on the half-integer lattice are doubled into integers, relative
+        // to the lower corner so the values stay small.
+        m_exact = n > 0 && 2 * (max_x - min_x) <= MAX_EXACT_SPAN && 2 * (max_y - min_y) <= MAX_EXACT_SPAN;
+        if (m_exact) {
+            m_lattice.resize(2 * n);
+            for (std::size_t i = 0; i < 2 * n && m_exact; i++) {
+                const double v = 2 * (coords[i] - ((i & 1) ? min_y : min_x));
+                m_exact = v == std::floor(v);
+                m_lattice[i] = static_cast<std::int64_t>(v);
+            }
+        }
+
         const double cx = (min_x + max_x) / 2;
         const double cy = (min_y + max_y) / 2;
         double min_dist = std::numeric_limits<double>::max();
@@ -257,6 +327,11 @@ namespace delaunator {
             }
         }
 
+        if (i0 == INVALID_INDEX) {
+            collinear_hull(i0);
+            return;
+        }
+
         const double i0x = coords[2 * i0];
         const double i0y = coords[2 * i0 + 1];
 
@@ -272,6 +347,11 @@ namespace delaunator {
             }
         }
 
+        if (i1 == INVALID_INDEX) {
+            collinear_hull(i0);
+            return;
+        }
+
         double i1x = coords[2 * i1];
         double i1y = coords[2 * i1 + 1];
 
@@ -290,14 +370,18 @@ namespace delaunator {
             }
         }
 
+        // Every third point is collinear with the first two. On the lattice the
+        // circumradius denominator is an exact product of small integers, so
+        // this is decided exactly there.
         if (!(min_radius < std::numeric_limits<double>::max())) {
-            throw std::runtime_error("not triangulation");
+            collinear_hull(i0);
+            return;
         }
 
         double i2x = coords[2 * i2];
         double i2y = coords[2 * i2 + 1];
 
-        if (orient(i0x, i0y, i1x, i1y, i2x, i2y)) {
+        if (orient_ids(i0, i1, i2)) {
             std::swap(i1, i2);
             std::swap(i1x, i2x);
             std::swap(i1y, i2y);
@@ -369,7 +453,7 @@ namespace delaunator {
             size_t e = start;
             size_t q;
 
-            while (q = hull_next[e], !orient(x, y, coords[2 * e], coords[2 * e + 1], coords[2 * q], coords[2 * q + 1])) { //TODO: does it works in a same way as in JS
+            while (q = hull_next[e], !orient_ids(i, e, q)) { //TODO: does it works in a same way as in JS
                 e = q;
                 if (e == start) {
                     e = INVALID_INDEX;
@@ -396,7 +480,7 @@ namespace delaunator {
             std::size_t next = hull_next[e];
             while (
                 q = hull_next[next],
-                orient(x, y, coords[2 * next], coords[2 * next + 1], coords[2 * q], coords[2 * q + 1])) {
+                orient_ids(i, next, q)) {
                 t = add_triangle(next, i, q, hull_tri[i], INVALID_INDEX, hull_tri[next]);
                 hull_tri[i] = legalize(t + 2);
                 hull_next[next] = next; // mark as removed
@@ -408,7 +492,7 @@ namespace delaunator {
             if (e == start) {
                 while (
                     q = hull_prev[e],
-                    orient(x, y, coords[2 * q], coords[2 * q + 1], coords[2 * e], coords[2 * e + 1])) {
+                    orient_ids(i, q, e)) {
                     t = add_triangle(q, i, e, INVALID_INDEX, hull_tri[e], hull_tri[q]);
                     legalize(t + 2);
                     hull_tri[q] = t;
@@ -430,8 +514,57 @@ namespace delaunator {
         }
     }
 
-    double Delaunator::get_hull_area() {
-        std::vector<double> hull_area;
+    // No triangles: the hull is the chain of distinct points in order along the
+    // line, closed back on itself, so walking hull_next from hull_start visits
+    // each segment between neighbouring points once before the wrap-around.
+    inline void Delaunator::collinear_hull(std::size_t i0) {
+        std::vector<double> const& coords = *m_coords;
+        std::vector<std::size_t>& ids = m_ids;
+        const std::size_t n = ids.size();
+        hull_prev.assign(n, INVALID_INDEX);
+        hull_next.assign(n, INVALID_INDEX);
+        hull_tri.assign(n, INVALID_INDEX);
+        hull_start = 0;
+        if (n == 0) return;
+
+        // The line's direction, towards the point farthest from i0.
+        const double x0 = coords[2 * i0];
+        const double y0 = coords[2 * i0 + 1];
+        double dx = 0.0;
+        double dy = 0.0;
+        for (std::size_t i = 0; i < n; i++) {
+            const double ex = coords[2 * i] - x0;
+            const double ey = coords[2 * i + 1] - y0;
+            if (ex * ex + ey * ey > dx * dx + dy * dy) {
+                dx = ex;
+                dy = ey;
+            }
+        }
+        std::vector<double>& key = m_line_keys;
+        key.resize(n);
+        for (std::size_t i = 0; i < n; i++)
+            key[i] = (coords[2 * i] - x0) * dx + (coords[2 * i + 1] - y0) * dy;
+        std::sort(ids.begin(), ids.end(), [&key](std::size_t a, std::size_t b) {
+            return key[a] < key[b] || (key[a] == key[b] && a < b);
+        });
+
+        hull_start = ids[0];
+        std::size_t last = hull_start;
+        for (std::size_t k = 1; k < n; k++) {
+            const std::size_t i = ids[k];
+            if (check_pts_equal(coords[2 * i], coords[2 * i + 1], coords[2 * last], coords[2 * last + 1])) continue;
+            hull_next[last] = i;
+            hull_prev[i] = last;
+            last = i;
+        }
+        hull_next[last] = hull_start;
+        hull_prev[hull_start] = last;
+    }
+
+    inline double Delaunator::get_hull_area() {
+        std::vector<double> const& coords = *m_coords;
+        std::vector<double>& hull_area = m_hull_area;
+        hull_area.clear();
         size_t e = hull_start;
         do {
             hull_area.push_back((coords[2 * e] - coords[2 * hull_prev[e]]) * (coords[2 * e + 1] + coords[2 * hull_prev[e] + 1]));
@@ -440,7 +573,7 @@ namespace delaunator {
         return sum(hull_area);
     }
 
-    std::size_t Delaunator::legalize(std::size_t a) {
+    inline std::size_t Delaunator::legalize(std::size_t a) {
         std::size_t i = 0;
         std::size_t ar = 0;
         m_edge_stack.clear();
@@ -488,15 +621,7 @@ namespace delaunator {
             const std::size_t pl = triangles[al];
             const std::size_t p1 = triangles[bl];
 
-            const bool illegal = in_circle(
-                coords[2 * p0],
-                coords[2 * p0 + 1],
-                coords[2 * pr],
-                coords[2 * pr + 1],
-                coords[2 * pl],
-                coords[2 * pl + 1],
-                coords[2 * p1],
-                coords[2 * p1 + 1]);
+            const bool illegal = in_circle_ids(p0, pr, pl, p1);
 
             if (illegal) {
                 triangles[a] = p1;
@@ -543,6 +668,25 @@ namespace delaunator {
         return ar;
     }
 
+    inline bool Delaunator::orient_ids(std::size_t p, std::size_t q, std::size_t r) const {
+        if (m_exact) {
+            const std::int64_t* l = m_lattice.data();
+            return orient_exact(l[2 * p], l[2 * p + 1], l[2 * q], l[2 * q + 1], l[2 * r], l[2 * r + 1]);
+        }
+        std::vector<double> const& coords = *m_coords;
+        return orient(coords[2 * p], coords[2 * p + 1], coords[2 * q], coords[2 * q + 1], coords[2 * r], coords[2 * r + 1]);
+    }
+
+    inline bool Delaunator::in_circle_ids(std::size_t a, std::size_t b, std::size_t c, std::size_t p) const {
+        if (m_exact) {
+            const std::int64_t* l = m_lattice.data();
+            return in_circle_exact(l[2 * a], l[2 * a + 1], l[2 * b], l[2 * b + 1], l[2 * c], l[2 * c + 1], l[2 * p], l[2 * p + 1]);
+        }
+        std::vector<double> const& coords = *m_coords;
+        return in_circle(coords[2 * a], coords[2 * a + 1], coords[2 * b], coords[2 * b + 1],
+            coords[2 * c], coords[2 * c + 1], coords[2 * p], coords[2 * p + 1]);
+    }
+
     inline std::size_t Delaunator::hash_key(const double x, const double y) const {
         const double dx = x - m_center_x;
         const double dy = y - m_center_y;
@@ -551,7 +695,7 @@ namespace delaunator {
             m_hash_size);
     }
 
-    std::size_t Delaunator::add_triangle(
+    inline std::size_t Delaunator::add_triangle(
         std::size_t i0,
         std::size_t i1,
         std::size_t i2,
@@ -568,7 +712,7 @@ namespace delaunator {
         return t;
     }
 
-    void Delaunator::link(const std::size_t a, const std::size_t b) {
+    inline void Delaunator::link(const std::size_t a, const std::size_t b) {
         std::size_t s = halfedges.size();
         if (a == s) {
             halfedges.push_back(b);